@@ -0,0 +1,16 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <time.h>
+
+// Helpers shared by the benchmarks
+
+// Seconds on a monotonic clock
+static inline double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif // BENCH_H_
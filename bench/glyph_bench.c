@@ -0,0 +1,111 @@
+// Startup cost of the glyph cache: setting it up and rasterizing the glyphs of a first
+// screen with nothing on disk, against loading them from the cache file saved by the
+// previous run. Usage: glyph_bench [FONT [PIXEL_SIZE]], from the repository root.
+// Needs an OpenGL context, so it opens a hidden window.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "bench.h"
+#include "glyph_cache.h"
+#include "lib.h"
+#include "pool.h"
+
+#define BENCH_ROUNDS 5
+
+// Printable ASCII and Latin-1, about what a first screen of text needs
+static void request_screen(glyph_cache_t *gc)
+{
+    for (uint32_t c = ' '; c < 0x100; c++) {
+        if (c < 0x7f || c >= 0xa0) {
+            gc_request(gc, c);
+        }
+    }
+    gc_prefetch(gc);
+}
+
+// Start up once, returning the time until the glyphs are uploaded. Removing the cache
+// file afterwards makes the next start cold.
+static double start_up(
+        char const *font, FT_UInt pixel_size, pool_t *pool, bool remove, bool *loaded,
+        double *save_seconds)
+{
+    glyph_cache_t gc;
+    double start = bench_now();
+    gc_init(&gc, font, pixel_size, pool);
+    request_screen(&gc);
+    glFinish();
+    double seconds = bench_now() - start;
+    *loaded = gc.loaded;
+
+    start = bench_now();
+    if (!gc_save(&gc)) {
+        panic("Could not save the glyph cache to %s", gc.cache_path);
+    }
+    *save_seconds = bench_now() - start;
+    if (remove) {
+        unlink(gc.cache_path);
+    }
+    gc_free(&gc);
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    char const *font = argc > 1 ? argv[1] : "fonts/VictorMono-Regular.ttf";
+    FT_UInt pixel_size = argc > 2 ? atoi(argv[2]) : 128;
+
+    // Keep the user's cache out of it
+    char cache_home[] = "/tmp/med-glyph-bench-XXXXXX";
+    if (mkdtemp(cache_home) == NULL) {
+        panic("Could not create a cache directory");
+    }
+    setenv("XDG_CACHE_HOME", cache_home, 1);
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "glyph_bench", NULL, NULL);
+    if (window == NULL) {
+        panic("Could not create a window");
+    }
+    glfwMakeContextCurrent(window);
+    GLenum code;
+    if ((code = glewInit()) != GLEW_OK) {
+        panic("Could not initialize glew: %s", glewGetErrorString(code));
+    }
+
+    pool_t pool = { 0 };
+    pool_init(&pool, max(sysconf(_SC_NPROCESSORS_ONLN), 1));
+
+    printf("%s at %u px, %zu workers\n", font, pixel_size, pool_workers(&pool));
+    printf("%-6s %12s %12s\n", "cache", "startup", "save");
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        // Nothing on disk, then the file the cold start saved
+        for (int warm = 0; warm < 2; warm++) {
+            bool loaded;
+            double save;
+            double seconds = start_up(font, pixel_size, &pool, warm, &loaded, &save);
+            printf("%-6s %9.2f ms %9.2f ms\n", loaded ? "warm" : "cold", seconds * 1e3,
+                   save * 1e3);
+        }
+    }
+
+    char dir[sizeof cache_home + 4];
+    snprintf(dir, sizeof dir, "%s/med", cache_home);
+    rmdir(dir);
+    rmdir(cache_home);
+    pool_free(&pool);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
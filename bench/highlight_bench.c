@@ -0,0 +1,183 @@
+// Draw calls and frame time for highlighting a whole buffer, as select-all does: a rect
+// and a draw call per line, all lines in one batch, and the batch clipped to the visible
+// rows that render_scene draws. Usage: highlight_bench [LINES], from the repository
+// root. Needs an OpenGL context, so it opens a hidden window.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "bench.h"
+#include "buffer.h"
+#include "freetype_renderer.h"
+#include "lib.h"
+#include "pool.h"
+#include "program_object.h"
+#include "renderer.h"
+
+#define BENCH_FRAMES    20
+#define VISIBLE_ROWS    120 // Rows of a maximized window at the smallest scale
+#define HIGHLIGHT_COLOR v4f(1, 1, 1, 0.3)
+
+static ft_renderer_t ftr;
+static renderer_t r;
+static buffer_t text;
+static size_t draws;
+
+static void draw(void)
+{
+    draws += (r.vertices.length + RENDERER_CHUNK_VERTICES - 1) / RENDERER_CHUNK_VERTICES;
+    renderer_draw(&r);
+}
+
+// The text is ASCII, so chunks never split a codepoint
+static v2f_t cursor_pos(size_t start, size_t end, v2f_t pos)
+{
+    while (start < end) {
+        strview_t chunk = buffer_chunk(&text, start);
+        chunk.length = min(chunk.length, end - start);
+        pos = ftr_cursor_pos(&ftr, chunk.data, chunk.length, pos);
+        start += chunk.length;
+    }
+    return pos;
+}
+
+// Same as render_highlight in main.c: one rect per line of [start, end), each placed
+// relative to the start of its line. With `flush`, every rect is drawn on its own.
+static void highlight(size_t start, size_t end, bool flush)
+{
+    size_t row = buffer_row(&text, start);
+    v2f_t pos = v2f(0, -(float) row * ftr.line_height);
+    pos = cursor_pos(buffer_line_start(&text, row), start, pos);
+    while (start < end) {
+        size_t line_end = min(buffer_find_char(&text, '\n', start), end);
+        v2f_t end_pos = cursor_pos(start, line_end, pos);
+        end_pos.x += ftr_char_width(&ftr, ' ') * (line_end != end);
+        renderer_solid_rect(
+                &r, v2f(pos.x, pos.y - ftr.line_low),
+                v2f(end_pos.x - pos.x, ftr.line_height), HIGHLIGHT_COLOR);
+        if (flush) {
+            draw();
+        }
+        start = line_end + 1;
+        pos = v2f(0, pos.y - ftr.line_height);
+    }
+}
+
+// Select-all as drawn in one frame
+static void per_line(void)
+{
+    highlight(0, buffer_length(&text), true);
+}
+
+static void batched(void)
+{
+    highlight(0, buffer_length(&text), false);
+    draw();
+}
+
+static void clipped(void)
+{
+    size_t first = buffer_line_count(&text) / 2;
+    size_t last = min(first + VISIBLE_ROWS, buffer_line_count(&text) - 1);
+    size_t start = buffer_line_start(&text, first);
+    size_t end = buffer_line_start(&text, last) + buffer_line_length(&text, last);
+    highlight(start, end, false);
+    draw();
+}
+
+int main(int argc, char **argv)
+{
+    size_t line_count = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(800, 600, "highlight_bench", NULL, NULL);
+    if (window == NULL) {
+        panic("Could not create a window");
+    }
+    glfwMakeContextCurrent(window);
+    GLenum code;
+    if ((code = glewInit()) != GLEW_OK) {
+        panic("Could not initialize glew: %s", glewGetErrorString(code));
+    }
+
+    GLuint basic_program;
+    pool_t pool;
+    GLuint frame_ubo;
+    pool_init(&pool, max(sysconf(_SC_NPROCESSORS_ONLN), 1));
+    renderer_init(&r);
+    if (!program_object_link(
+                &basic_program, (char const *[]) { "shaders/camera.vert" }, 1,
+                (char const *[]) { "shaders/basic_color.frag" }, 1) ||
+        !ftr_init(&ftr, "fonts/VictorMono-Regular.ttf", 128, &pool)) {
+        return 1;
+    }
+    program_object_frame_init(&frame_ubo);
+    frame_uniforms_t frame = {
+        .resolution = v2f(800, 600),
+        .scale = 0.225,
+    };
+    program_object_frame_update(frame_ubo, &frame);
+    program_object_frame_bind(frame_ubo);
+    program_object_use(basic_program);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Lines of 0 to 120 bytes
+    buffer_init(&text, BUFFER_GAP);
+    char line[128];
+    srand(1);
+    for (size_t i = 0; i < line_count; i++) {
+        size_t length = rand() % 121;
+        for (size_t j = 0; j < length; j++) {
+            line[j] = 'a' + j % 26;
+        }
+        line[length] = '\n';
+        buffer_insert(&text, line, length + 1, buffer_length(&text));
+    }
+    ftr_request(&ftr, line, 26);
+    ftr_prefetch(&ftr);
+
+    static struct {
+        char const *name;
+        void (*fn)(void);
+        size_t frames;
+    } const modes[] = {
+        { "per line", per_line, 1 },
+        { "batched", batched, 1 },
+        { "clipped", clipped, BENCH_FRAMES },
+    };
+    printf("%zu lines, %d visible\n", line_count, VISIBLE_ROWS);
+    printf("%-10s %10s %12s\n", "mode", "draws", "frame");
+    for (size_t m = 0; m < sizeof modes / sizeof *modes; m++) {
+        draws = 0;
+        double start = bench_now();
+        for (size_t f = 0; f < modes[m].frames; f++) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            modes[m].fn();
+            glFinish();
+        }
+        double frame_seconds = (bench_now() - start) / modes[m].frames;
+        printf("%-10s %10zu %9.3f ms\n", modes[m].name, draws / modes[m].frames,
+               frame_seconds * 1e3);
+    }
+
+    buffer_free(&text);
+    ftr_free(&ftr);
+    renderer_free(&r);
+    program_object_frame_free(frame_ubo);
+    pool_free(&pool);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Cost of the row and column queries answered by the line index, against finding the
+// same by scanning the text from the start as the renderer used to
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "buffer.h"
+#include "lib.h"
+
+#define BENCH_QUERIES 100000 // Queries through the index per measurement
+#define BENCH_SCANS   100    // Queries by scanning, which take time linear in the offset
+#define BENCH_EDITS   10000
+
+// The `i`th of a sequence of offsets spread over [0, n)
+static size_t spread(size_t i, size_t n)
+{
+    return i * 2654435761u % n;
+}
+
+static size_t scan_row(buffer_t const *b, size_t index)
+{
+    size_t row = 0;
+    for (size_t at = 0; at < index;) {
+        strview_t chunk = buffer_chunk(b, at);
+        chunk.length = min(chunk.length, index - at);
+        row += sv_count_char(chunk, '\n');
+        at += chunk.length;
+    }
+    return row;
+}
+
+static size_t scan_line_start(buffer_t const *b, size_t index)
+{
+    while (index > 0) {
+        strview_t chunk = buffer_chunk_rev(b, index);
+        char const *p = memrchr(chunk.data, '\n', chunk.length);
+        if (p != NULL) {
+            return index - chunk.length + (p - chunk.data) + 1;
+        }
+        index -= chunk.length;
+    }
+    return 0;
+}
+
+// Offset of the first byte of `row`
+static size_t scan_row_start(buffer_t const *b, size_t row)
+{
+    size_t at = 0;
+    while (row > 0 && at < buffer_length(b)) {
+        strview_t chunk = buffer_chunk(b, at);
+        char const *p = chunk.data;
+        char const *end = chunk.data + chunk.length;
+        while (row > 0 && (p = memchr(p, '\n', end - p)) != NULL) {
+            p++;
+            row--;
+        }
+        at += row > 0 ? chunk.length : (size_t) (p - chunk.data);
+    }
+    return at;
+}
+
+int main(void)
+{
+    size_t const line_counts[] = { 10000, 100000, 1000000 };
+    char const *const kind_names[] = { "gap", "piece" };
+    volatile size_t sink = 0;
+
+    printf("%-6s %8s %10s %12s %12s %12s %12s %10s\n", "kind", "lines", "build",
+           "pos index", "pos scan", "row index", "row scan", "edit");
+    for (size_t li = 0; li < sizeof line_counts / sizeof *line_counts; li++) {
+        // Lines of 0 to 160 bytes
+        str_t text = { 0 };
+        srand(1);
+        for (size_t i = 0; i < line_counts[li]; i++) {
+            size_t length = rand() % 160;
+            for (size_t j = 0; j < length; j++) {
+                char c = 'a' + j % 26;
+                str_push(&text, &c, 1);
+            }
+            str_push(&text, "\n", 1);
+        }
+
+        for (enum buffer_kind kind = BUFFER_GAP; kind <= BUFFER_PIECE; kind++) {
+            buffer_t b;
+            buffer_init(&b, kind);
+            double start = bench_now();
+            buffer_push(&b, text.data, text.length);
+            double build = bench_now() - start;
+            size_t length = buffer_length(&b);
+
+            // Offset to row and column
+            start = bench_now();
+            for (size_t i = 0; i < BENCH_QUERIES; i++) {
+                size_t index = spread(i, length);
+                size_t row = buffer_row(&b, index);
+                sink = row + index - buffer_line_start(&b, row);
+            }
+            double pos_index = (bench_now() - start) / BENCH_QUERIES;
+            start = bench_now();
+            for (size_t i = 0; i < BENCH_SCANS; i++) {
+                size_t index = spread(i, length);
+                sink = scan_row(&b, index) + index - scan_line_start(&b, index);
+            }
+            double pos_scan = (bench_now() - start) / BENCH_SCANS;
+
+            // Row to offset
+            size_t rows = buffer_line_count(&b);
+            start = bench_now();
+            for (size_t i = 0; i < BENCH_QUERIES; i++) {
+                sink = buffer_line_start(&b, spread(i, rows));
+            }
+            double row_index = (bench_now() - start) / BENCH_QUERIES;
+            start = bench_now();
+            for (size_t i = 0; i < BENCH_SCANS; i++) {
+                sink = scan_row_start(&b, spread(i, rows));
+            }
+            double row_scan = (bench_now() - start) / BENCH_SCANS;
+
+            // Insertions that split a line, which the index has to follow
+            start = bench_now();
+            for (size_t i = 0; i < BENCH_EDITS; i++) {
+                buffer_insert(&b, "a\nb", 3, spread(i, buffer_length(&b)));
+            }
+            double edit = (bench_now() - start) / BENCH_EDITS;
+
+            printf("%-6s %8zu %8.3f s %9.3f us %9.1f us %9.3f us %9.1f us %7.3f us\n",
+                   kind_names[kind], line_counts[li], build, pos_index * 1e6,
+                   pos_scan * 1e6, row_index * 1e6, row_scan * 1e6, edit * 1e6);
+            buffer_free(&b);
+        }
+        str_free(&text);
+    }
+    (void) sink;
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Time to save a large file in place and by replacing it, as the amount of modified text
+// grows. Usage: save_bench [FILE [MIB]]; FILE is overwritten and removed, and should be
+// on the disk files are normally edited on.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "lib.h"
+#include "save.h"
+
+#define BENCH_RANGES 256 // Edits spread over the file, fewer if less text is modified
+
+static void write_file(char const *path, size_t size)
+{
+    char block[4096];
+    for (size_t i = 0; i < sizeof block; i++) {
+        block[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+    }
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        panic("Could not create %s", path);
+    }
+    for (size_t n = 0; n < size; n += sizeof block) {
+        fwrite(block, 1, min(sizeof block, size - n), fp);
+    }
+    // Otherwise the first save would also sync these writes
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+}
+
+// Load the file and overwrite `dirty` bytes of it in BENCH_RANGES evenly spread edits
+static void load_modified(buffer_t *b, char const *path, size_t size, size_t dirty)
+{
+    FILE *fp = fopen(path, "r");
+    buffer_init_view(b, BUFFER_PIECE);
+    buffer_load_file(b, fp);
+    fclose(fp);
+
+    size_t count = min(dirty, BENCH_RANGES);
+    char *text = malloc(dirty / count + 1);
+    memset(text, 'X', dirty / count + 1);
+    for (size_t i = 0; i < count; i++) {
+        size_t length = dirty / count + (i < dirty % count);
+        size_t at = i * (size / count);
+        buffer_remove(b, length, at);
+        buffer_insert(b, text, length, at);
+    }
+    free(text);
+}
+
+static double save(save_t *s)
+{
+    save_wait(s);
+    if (s->failed != NULL) {
+        panic("Could not save %s (%s): %s", s->path, s->failed, strerror(s->error));
+    }
+    double seconds = s->seconds;
+    save_free(s);
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    char const *path = argc > 1 ? argv[1] : "save_bench.tmp";
+    size_t size = (argc > 2 ? strtoull(argv[2], NULL, 10) : 1024) << 20;
+    size_t const dirties[] = { 1, 4 << 10, 64 << 10, 1 << 20, 16 << 20, 256 << 20 };
+
+    printf("%zu MiB file\n", size >> 20);
+    printf("%12s %8s %12s %12s %12s\n", "dirty", "ranges", "written", "in place",
+           "replace");
+    for (size_t i = 0; i < sizeof dirties / sizeof *dirties && dirties[i] <= size; i++) {
+        buffer_t b;
+        save_t s = { 0 };
+
+        write_file(path, size);
+        load_modified(&b, path, size, dirties[i]);
+        buffer_ranges_t ranges = { 0 };
+        buffer_dirty_ranges(&b, size, &ranges);
+        size_t range_count = ranges.length;
+        for (size_t r = 0; r < ranges.length; r++) {
+            buffer_detach(&b, ranges.data[r].start, ranges.data[r].length);
+        }
+        buffer_snapshot_t snapshot;
+        buffer_snapshot_ranges(&b, ranges.data, ranges.length, &snapshot);
+        save_start_in_place(&s, path, &snapshot, &ranges);
+        size_t written = s.length;
+        double in_place = save(&s);
+        buffer_free(&b);
+
+        write_file(path, size);
+        load_modified(&b, path, size, dirties[i]);
+        buffer_snapshot(&b, &snapshot);
+        save_start(&s, path, &snapshot);
+        double replace = save(&s);
+        buffer_free(&b);
+
+        printf("%12zu %8zu %12zu %10.3f s %10.3f s\n", dirties[i], range_count, written,
+               in_place, replace);
+    }
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Time to find every match of a query in a large buffer, as the I-Search match count
+// does, with 1 to 8 workers. Usage: search_bench [MIB]. The workers only help as far as
+// there are CPUs to run them.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "buffer.h"
+#include "lib.h"
+#include "pool.h"
+#include "search.h"
+
+#define BENCH_ROUNDS 3 // The fastest one is reported
+
+// Lines of 0 to 120 random lowercase letters and spaces
+static void fill(buffer_t *b, size_t size)
+{
+    char block[64 << 10];
+    uint64_t state = 88172645463325252u;
+    size_t line = 0;
+    for (size_t n = 0; n < size; n += sizeof block) {
+        for (size_t i = 0; i < sizeof block; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            if (line == 0) {
+                line = state % 121 + 1;
+                block[i] = '\n';
+            } else {
+                block[i] = state % 27 == 26 ? ' ' : 'a' + state % 27;
+            }
+            line--;
+        }
+        buffer_push(b, block, min(sizeof block, size - n));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1 ? strtoull(argv[1], NULL, 10) : 1024) << 20;
+    size_t const workers[] = { 1, 2, 4, 8 };
+    static struct {
+        char const *name;
+        char const *needle;
+    } const needles[] = {
+        { "e", "e" },
+        { "med", "med" },
+        { "search", "search" },
+        { "\\n\\n", "\n\n" }, // Empty lines
+    };
+
+    buffer_t b;
+    buffer_init(&b, BUFFER_GAP);
+    fill(&b, size);
+
+    printf("%zu MiB\n", size >> 20);
+    printf("%-8s %8s %12s %12s %10s\n", "needle", "workers", "matches", "time", "GB/s");
+    for (size_t ni = 0; ni < sizeof needles / sizeof *needles; ni++) {
+        for (size_t wi = 0; wi < sizeof workers / sizeof *workers; wi++) {
+            pool_t pool;
+            pool_init(&pool, workers[wi]);
+            char const *needle = needles[ni].needle;
+            search_matches_t matches = { 0 };
+            double best = 0;
+            for (int round = 0; round < BENCH_ROUNDS; round++) {
+                double start = bench_now();
+                search_all(&pool, &b, needle, strlen(needle), &matches);
+                double seconds = bench_now() - start;
+                best = round == 0 ? seconds : min(best, seconds);
+            }
+            printf("%-8s %8zu %12zu %9.1f ms %10.2f\n", needles[ni].name, workers[wi],
+                   matches.length, best * 1e3, size / best / 1e9);
+            da_free(&matches);
+            pool_free(&pool);
+        }
+    }
+    buffer_free(&b);
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Throughput of the newline scans behind line motions and the line index, for every
+// vector instruction set the CPU supports. The str_find_char functions go through the C
+// library's memchr and memrchr, so they only change with the line length.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "lib.h"
+#include "str.h"
+
+#define BENCH_BYTES (256 << 20) // Bytes scanned per measurement
+
+static volatile size_t sink; // Keeps results alive
+
+// Every line front to back, like repeated next-line motions
+static void walk_find_char(str_t const *s)
+{
+    for (size_t i = 0; i < s->length; i = str_find_char(s, '\n', i) + 1) {
+        sink = i;
+    }
+}
+
+static void walk_find_char_rev(str_t const *s)
+{
+    for (size_t i = s->length; i > 0; i = str_find_char_rev(s, '\n', i - 1)) {
+        sink = i;
+    }
+}
+
+static void count(str_t const *s)
+{
+    sink = str_count(s, '\n', 0);
+}
+
+static void count_rev(str_t const *s)
+{
+    sink = str_count_rev(s, '\n', s->length);
+}
+
+static void count_char(str_t const *s)
+{
+    sink = sv_count_char(sv_from_str(s), '\n');
+}
+
+static struct {
+    char const *name;
+    void (*fn)(str_t const *s);
+} const functions[] = {
+    { "str_find_char", walk_find_char },
+    { "str_find_char_rev", walk_find_char_rev },
+    { "str_count", count },
+    { "str_count_rev", count_rev },
+    { "sv_count_char", count_char },
+};
+
+static char const *const level_names[] = {
+    [SIMD_NONE] = "scalar",
+    [SIMD_SSE2] = "sse2",
+    [SIMD_AVX2] = "avx2",
+};
+
+int main(void)
+{
+    size_t const sizes[] = { 4 << 10, 256 << 10, 64 << 20 };
+    size_t const densities[] = { 8, 80, 4096, 0 }; // Bytes per line, 0 for none
+
+    printf("%-18s %-7s %10s %9s %10s\n", "function", "simd", "bytes", "line", "GB/s");
+    for (size_t si = 0; si < sizeof sizes / sizeof *sizes; si++) {
+        for (size_t di = 0; di < sizeof densities / sizeof *densities; di++) {
+            str_t s = { 0 };
+            char *data = malloc(sizes[si]);
+            size_t line = densities[di];
+            for (size_t i = 0; i < sizes[si]; i++) {
+                data[i] = line > 0 && i % line == line - 1 ? '\n' : 'a' + i % 26;
+            }
+            str_push(&s, data, sizes[si]);
+            free(data);
+
+            size_t reps = max(BENCH_BYTES / sizes[si], 1);
+            for (size_t f = 0; f < sizeof functions / sizeof *functions; f++) {
+                for (enum simd level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+                    sv_simd_limit(level);
+                    if (sv_simd_level() != level) {
+                        continue;
+                    }
+                    functions[f].fn(&s);
+                    double start = bench_now();
+                    for (size_t r = 0; r < reps; r++) {
+                        functions[f].fn(&s);
+                    }
+                    double seconds = bench_now() - start;
+                    printf("%-18s %-7s %10zu %9zu %10.2f\n", functions[f].name,
+                           level_names[level], sizes[si], densities[di],
+                           (double) reps * sizes[si] / seconds / 1e9);
+                }
+            }
+            str_free(&s);
+        }
+    }
+    sv_simd_limit(SIMD_AVX2);
+    return 0;
+}
@@ -0,0 +1,166 @@
+#ifndef BUFFER_H_
+#define BUFFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "file_view.h"
+#include "da.h"
+#include "gap_buffer.h"
+#include "line_index.h"
+#include "piece_table.h"
+#include "str.h"
+
+enum buffer_kind {
+    BUFFER_GAP,
+    BUFFER_PIECE,
+    BUFFER_VIEW, // Read-only mapping of a file, turned into `edit_kind` on the first edit
+    BUFFER_KIND_COUNT,
+};
+
+typedef struct {
+    size_t start;
+    size_t length;
+} buffer_range_t;
+
+typedef da(buffer_range_t) buffer_ranges_t;
+
+// The `length` bytes of text at `start` replaced `file_length` bytes of the file
+typedef struct {
+    size_t start;
+    size_t length;
+    size_t file_length;
+} buffer_dirty_t;
+
+typedef da(buffer_dirty_t) buffer_dirty_list_t;
+
+// Text storage used by the editor. The text is not necessarily contiguous in memory, so
+// it must only be read through the functions below. A zeroed out buffer is a valid empty
+// gap buffer.
+//
+// Edits are recorded as sorted, disjoint dirty ranges. Outside of them the text matches
+// the file it was loaded from or last saved to, shifted by the length differences of the
+// ranges before. While a save runs, edits are also recorded against the text being
+// saved, in `unsaved`, which replace the dirty ranges once the save succeeded.
+//
+// Lines of loaded files are indexed lazily: the line index is exact up to `indexed` and
+// its last line spans the rest of the text. The `buffer_index_*` functions extend it.
+typedef struct {
+    enum buffer_kind kind;
+    enum buffer_kind edit_kind;
+    union {
+        gb_t gb;
+        pt_t pt;
+        fv_t fv;
+    };
+    line_index_t lines;
+    size_t indexed;
+    buffer_dirty_list_t dirty;
+    buffer_dirty_list_t unsaved;
+    bool saving;
+    size_t version; // Changes on every modification; unique across all buffers
+} buffer_t;
+
+// Immutable copy of the text of a buffer, made in time proportional to the number of
+// pieces for buffers that never move their bytes, and by copying the text otherwise
+typedef struct {
+    da(strview_t) spans;
+    char *copy; // NULL when the spans point into the buffer
+    size_t length;
+} buffer_snapshot_t;
+
+void buffer_free(buffer_t *b);
+void buffer_init(buffer_t *b, enum buffer_kind kind);
+// Files loaded into the buffer are only mapped until they are first modified
+void buffer_init_view(buffer_t *b, enum buffer_kind edit_kind);
+
+size_t buffer_length(buffer_t const *b);
+char buffer_at(buffer_t const *b, size_t index);
+
+#define buffer_push(b, data, len)           buffer_insert(b, data, len, buffer_length(b))
+#define buffer_insert_cstr(b, cstr, index) buffer_insert(b, cstr, strlen(cstr), index)
+#define buffer_push_cstr(b, cstr)          buffer_insert_cstr(b, cstr, buffer_length(b))
+void buffer_insert(buffer_t *b, char const *data, size_t length, size_t index);
+void buffer_remove(buffer_t *b, size_t length, size_t index);
+// Insert text made of spans from `buffer_chunk`, such as removed text being restored.
+// Stable buffers reference the spans instead of copying them.
+void buffer_insert_spans(
+        buffer_t *b, strview_t const *spans, size_t count, size_t index);
+// Append text that was read from the file the buffer is loading, which isn't an edit
+void buffer_append_loaded(buffer_t *b, char const *data, size_t length);
+
+// Whether the bytes behind chunks stay valid and unchanged through edits, until the
+// buffer is freed. Mapped files can still be overwritten in place, see `buffer_mapping`.
+bool buffer_stable(buffer_t const *b);
+// Mapped file chunks may point into, empty if there is none
+strview_t buffer_mapping(buffer_t const *b);
+
+strview_t buffer_chunk(buffer_t const *b, size_t index);
+strview_t buffer_chunk_rev(buffer_t const *b, size_t index);
+void buffer_slice(buffer_t const *b, str_t *out, size_t index, size_t length);
+
+// Lines are numbered from 0; there is always at least one line
+size_t buffer_line_count(buffer_t const *b);
+size_t buffer_line_start(buffer_t const *b, size_t row);
+size_t buffer_line_length(buffer_t const *b, size_t row);
+size_t buffer_row(buffer_t const *b, size_t index);
+
+// Rendered line widths, kept by the line index until the line is edited
+void buffer_set_line_width(buffer_t *b, size_t row, float width);
+float buffer_max_line_width(buffer_t const *b, size_t first, size_t last);
+size_t buffer_unmeasured_line(buffer_t const *b, size_t row);
+
+// Index lines up to byte `index`, resp. until rows [0, row] are exact
+void buffer_index_to(buffer_t *b, size_t index);
+void buffer_index_rows(buffer_t *b, size_t row);
+// Index at most `bytes` more bytes; returns true once the whole text is indexed
+bool buffer_index_step(buffer_t *b, size_t bytes);
+bool buffer_indexed(buffer_t const *b);
+
+size_t buffer_find_char(buffer_t const *b, char c, size_t index);
+size_t buffer_find_char_rev(buffer_t const *b, char c, size_t index);
+size_t buffer_count(buffer_t const *b, char c, size_t index);
+size_t buffer_count_rev(buffer_t const *b, char c, size_t index);
+
+// Start of the first occurrence of `needle` at or after `index`, resp. of the last one
+// that starts before `index`. Both return the buffer length when there is none.
+size_t buffer_search(
+        buffer_t const *b, char const *needle, size_t needle_length, size_t index);
+size_t buffer_search_rev(
+        buffer_t const *b, char const *needle, size_t needle_length, size_t index);
+// Same as `buffer_search` for the occurrences that start before `end`, returns `end` when
+// there is none
+size_t buffer_search_before(
+        buffer_t const *b, char const *needle, size_t needle_length, size_t index,
+        size_t end);
+
+void buffer_load_file(buffer_t *b, FILE *fp);
+// Take over a mapping from `fv_load_file`. A view that is still empty starts reading from
+// it; any other buffer gets a copy appended.
+void buffer_load_view(buffer_t *b, fv_t *fv);
+void buffer_write_file(buffer_t const *b, FILE *fp);
+// The snapshot stays valid while the buffer is edited, but not after it is freed
+void buffer_snapshot(buffer_t const *b, buffer_snapshot_t *out);
+// Copy of each range, one span per range
+void buffer_snapshot_ranges(
+        buffer_t const *b, buffer_range_t const *ranges, size_t count,
+        buffer_snapshot_t *out);
+void buffer_snapshot_free(buffer_snapshot_t *snapshot);
+// A save of the current text started
+void buffer_save_start(buffer_t *b);
+// The save finished. When it succeeded only the edits made since it started are left
+// dirty, otherwise the dirty ranges stay as if there had been no save.
+void buffer_save_end(buffer_t *b, bool saved);
+// Whether the text was edited since it was loaded or last cleaned
+bool buffer_modified(buffer_t const *b);
+// Ranges to rewrite in place for the file to match the text. Returns false when that is
+// not possible because the text and the file differ in length.
+bool buffer_dirty_ranges(buffer_t const *b, size_t file_length, buffer_ranges_t *out);
+// Stop reading bytes [start, start + length) of the loaded file, which are about to be
+// overwritten
+void buffer_detach(buffer_t *b, size_t start, size_t length);
+
+bool buffer_readdir(buffer_t *b, char const *dirname, size_t *out_entry_count);
+
+#endif // BUFFER_H_
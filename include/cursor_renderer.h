@@ -5,18 +5,16 @@
 
 #include <stdbool.h>
 
+// Time, camera, scale and resolution come from the shared `Frame` uniform block
 enum cursor_uniform {
-    CU_TIME,
     CU_TIME_MOVED,
-    CU_SCALE,
-    CU_CAMERA,
-    CU_RESOLUTION,
     CU_COUNT,
 };
 
 typedef struct {
     renderer_t r;
     GLuint program;
+    GLint uniforms[CU_COUNT];
 } cursor_renderer_t;
 
 void cr_free(cursor_renderer_t *cr);
@@ -22,6 +22,7 @@
     do {                                       \
         if ((da)->capacity > 0) {              \
             free((da)->data);                  \
+            (da)->data = NULL;                 \
             (da)->length = (da)->capacity = 0; \
         }                                      \
     } while (0)
@@ -32,7 +33,7 @@
         if (cap < DA_INIT_CAP) {                                            \
             cap = DA_INIT_CAP;                                              \
         }                                                                   \
-        while (cap < (a)->length + n) {                                     \
+        while (cap < (a)->length + (n)) {                                   \
             cap *= DA_GROW_RATE;                                            \
         }                                                                   \
         if (cap != (a)->capacity) {                                         \
@@ -41,13 +42,13 @@
         }                                                                   \
     } while (false)
 
-#define da_insert_n(a, src, n, index)                       \
-    do {                                                    \
-        da_grow_n(a, n);                                    \
-        memmove((a)->data + index + n, (a)->data + index,   \
-                ((a)->length - index) * DA_TYPESIZE(a));    \
-        memcpy((a)->data + index, src, DA_TYPESIZE(a) * n); \
-        (a)->length += (n);                                 \
+#define da_insert_n(a, src, n, index)                           \
+    do {                                                        \
+        da_grow_n(a, n);                                        \
+        memmove((a)->data + (index) + (n), (a)->data + (index), \
+                ((a)->length - (index)) * DA_TYPESIZE(a));      \
+        memcpy((a)->data + (index), src, DA_TYPESIZE(a) * (n)); \
+        (a)->length += (n);                                     \
     } while (false)
 
 #define da_push_n(a, src, n) da_insert_n(a, src, n, (a)->length)
@@ -61,15 +62,17 @@
         }                                                                        \
     } while (false)
 
-#define da_remove_n(a, n, index)                             \
-    do {                                                     \
-        assert(index + n <= (a)->length);                    \
-        memmove((a)->data + index, (a)->data + index + n,    \
-                ((a)->length - index + n) * DA_TYPESIZE(a)); \
-        (a)->length -= (n);                                  \
-        da_shrink(a);                                        \
+#define da_remove_n(a, n, index)                                 \
+    do {                                                         \
+        assert((index) + (n) <= (a)->length);                    \
+        memmove((a)->data + (index), (a)->data + (index) + (n),  \
+                ((a)->length - (index) - (n)) * DA_TYPESIZE(a)); \
+        (a)->length -= (n);                                      \
+        da_shrink(a);                                            \
     } while (false)
 
 #define da_remove(a, index) da_remove_n(a, 1, index)
 
+#define da_last(a) ((a)->data[(a)->length - 1])
+
 #endif // DA_H_
@@ -2,39 +2,89 @@
 #define EDITOR_H_
 
 #include <stddef.h>
-
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "buffer.h"
+#include "da.h"
+#include "loader.h"
+#include "pool.h"
+#include "save.h"
+#include "search.h"
 #include "str.h"
+#include "undo.h"
+
+#define EDITOR_DEFAULT_MEMORY (256 << 20) // Bytes of text kept for unmodified files
 
 typedef struct editor editor_t;
 typedef void (*editor_callback_fn)(editor_t *);
 
+// An open buffer with everything that belongs to it
+typedef struct {
+    buffer_t buffer;
+    size_t cursor;
+    bool mark_set; // Saved while another buffer is shown
+    size_t mark;
+
+    str_t pathname;
+    loader_t loader; // Reads the file into `buffer`
+    save_t save;     // Writes `buffer` back
+    // File `buffer` was last loaded from or saved to, if any. Outside of the dirty ranges
+    // of the buffer the two match.
+    bool known;
+    struct stat stat;
+    undo_t undo;
+
+    size_t used;   // When the buffer was last shown, for eviction
+    bool evicted;  // The text was dropped and is read again when the buffer is shown
+    size_t resume; // Cursor to restore once an evicted buffer is read again
+} editor_file_t;
+
 typedef struct editor {
-    // TODO: handle many buffers
-    str_t *buffer;      // Points to the currently focused buffer
+    buffer_t *buffer;   // Points to the currently focused buffer
     size_t *cursor;     // Cursor into the currently focused buffer
 
-    str_t text_buffer;
-    size_t text_cursor;
-
-    str_t pathname;
+    // Buffer shown in the window. Switching buffers only repoints `file`, `buffer` and
+    // `cursor`; `mark` is swapped with the one the file saved.
+    editor_file_t *file;
+    da(editor_file_t *) files; // Open buffers, `listing` isn't one of them
+    editor_file_t listing;     // Directory shown by fsnav, or the buffer list
+    size_t clock;              // Incremented whenever a buffer is shown
+    // Unmodified buffers that weren't shown for the longest time are evicted while the
+    // text of all of them is longer than this
+    size_t memory;
+    size_t undo_budget;           // For new buffers
+    enum buffer_kind buffer_kind; // Storage used for files loaded from disk
 
     bool mark_set;
     size_t mark;
 
     bool fsnav;
+    bool buffer_list; // fsnav lists the open buffers instead of a directory
     size_t fsnav_entry_count;
 
     bool mini;
     char const *miniprompt;
-    str_t minibuffer;
+    buffer_t minibuffer;
     size_t minicursor;
     editor_callback_fn minicallback;
+    editor_callback_fn minichange; // Called after every edit of the minibuffer
+
+    size_t search_origin; // Cursor when the search started
+    size_t search_match;  // Start of the current match
+    bool search_found;
+    bool search_forward;  // Direction of the last C-s or C-r, which typing continues
+    str_t search_query; // Query `search_match` was found for
+    // Every match of `search_query` in the text buffer, found in the background with the
+    // workers of `search_pool`
+    search_t search;
+    pool_t *search_pool;
 } editor_t;
 
 void editor_free(editor_t *e);
 void editor_new(editor_t *e);
 
-// Moving
+// Moving. Characters are UTF-8 sequences; columns count characters, not bytes.
 void editor_forward_char(editor_t *e);
 void editor_backward_char(editor_t *e);
 void editor_move_end_of_line(editor_t *e);
@@ -43,22 +93,43 @@ void editor_next_line(editor_t *e);
 void editor_previous_line(editor_t *e);
 
 // Editing
+void editor_insert(editor_t *e, char const *text, size_t text_size);
 void editor_self_insert(editor_t *e, char c);
 void editor_delete_backward_char(editor_t *e);
 void editor_delete_char(editor_t *e);
 void editor_newline(editor_t *e);
 void editor_set_mark(editor_t *e);
 void editor_reset(editor_t *e);
+// Undo the last edit of the text buffer, resp. redo the last undone one
+void editor_undo(editor_t *e);
+void editor_redo(editor_t *e);
 
 // Minibuffer
 void editor_minibuffer_terminate(editor_t *e);
 
-// I-Search
+// I-Search. While searching, these move to the next and the previous match.
 void editor_isearch(editor_t *e);
+void editor_isearch_backward(editor_t *e);
+bool editor_isearching(editor_t const *e);
+// Start finding every match of the query again if it or the text changed. Returns
+// whether they are still being found.
+bool editor_isearch_poll(editor_t *e);
+// Every match of the query in the text buffer, NULL while they are still being found
+search_matches_t const *editor_isearch_matches(editor_t const *e);
 
 // File I/O
+// Show the buffer of `filename`, reading the file unless it is open already
 void editor_load_file(editor_t *e, char const *filename);
+// Append what the loaders read since the last call; returns whether any is still loading
+bool editor_load_poll(editor_t *e);
 void editor_save_buffer(editor_t *e);
+// Returns whether a save is still being written
+bool editor_save_poll(editor_t *e);
+
+// Buffers
+void editor_switch(editor_t *e, editor_file_t *file);
+// List the open buffers, most recently shown first, to pick one with fsnav
+void editor_list_buffers(editor_t *e);
 
 // fsnav functions
 void editor_fsnav(editor_t *e);
@@ -68,7 +139,7 @@ void editor_fsnav_find_file(editor_t *e);
 size_t editor_get_line_count(editor_t const *e);
 size_t editor_get_cursor_row(editor_t const *e);
 size_t editor_get_cursor_col(editor_t const *e);
-char editor_get_char(editor_t const *e);
+uint32_t editor_get_codepoint(editor_t const *e);
 size_t editor_nth_char_index(editor_t const *e, char c, size_t nth);
 
 #endif // EDITOR_H_
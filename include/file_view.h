@@ -0,0 +1,31 @@
+#ifndef FILE_VIEW_H_
+#define FILE_VIEW_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "str.h"
+
+// Read-only mapping of a whole file. Opening it costs the same regardless of the file
+// size; pages are only read once the text is looked at.
+typedef struct {
+    char *data;
+    size_t length;
+} fv_t;
+
+void fv_free(fv_t *fv);
+
+size_t fv_length(fv_t const *fv);
+char fv_at(fv_t const *fv, size_t index);
+
+strview_t fv_chunk(fv_t const *fv, size_t index);
+strview_t fv_chunk_rev(fv_t const *fv, size_t index);
+
+// Returns false, leaving `fv` empty, when the file is empty or can't be mapped
+bool fv_load_file(fv_t *fv, FILE *fp);
+
+// Hand the mapping over to the caller, who becomes responsible for unmapping it
+char *fv_release(fv_t *fv);
+
+#endif // FILE_VIEW_H_
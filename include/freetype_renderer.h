@@ -7,10 +7,10 @@
 #include <freetype2/ft2build.h>
 #include FT_FREETYPE_H
 
+#include "da.h"
+#include "glyph_cache.h"
 #include "la.h"
-#include "renderer.h"
-
-#define METRICS_LENGTH 128
+#include "stream.h"
 
 enum ft_program {
     FTP_RAINBOW,
@@ -18,60 +18,69 @@ enum ft_program {
     FTP_COUNT,
 };
 
+// Time, camera, scale and resolution come from the shared `Frame` uniform block
 enum ft_uniform {
-    FTU_TIME,
-    FTU_RESOLUTION,
-    FTU_CAMERA,
-    FTU_SCALE,
+    FTU_GLYPHS,
     FTU_COUNT,
 };
 
+// One instance per glyph; glyph.vert expands it into a quad using the glyph table
 typedef struct {
-    float ax; // advance.x
-    float ay; // advance.y
-    float bw; // bitmap.width;
-    float bh; // bitmap.rows;
-    float bl; // bitmap_left;
-    float bt; // bitmap_top;
-    float tx; // x offset of glyph in texture coordinates
-} ft_glyph_metrics_t;
+    v2f_t pos;    // Pen position on the baseline
+    GLuint glyph; // Index into the glyph cache's table
+    GLuint color; // RGBA8
+} glyph_instance_t;
 
+// Glyph instances kept on the GPU across frames, for text that rarely changes
 typedef struct {
-    renderer_t r;
-    GLuint atlas;
+    GLuint vbo;
+    size_t count;
+} ftr_layer_t;
 
-    FT_UInt atlas_w;
-    FT_UInt atlas_h;
-    FT_UInt atlas_low;
+typedef struct {
+    GLuint vao;
+    stream_t stream;
+    da(glyph_instance_t) instances;
 
-    GLuint program[FTP_COUNT];
-    enum ft_program current_program;
+    glyph_cache_t glyphs;
+    da(uint32_t) requeue; // Scratch for re-resolving queued glyphs after an eviction
 
-    ft_glyph_metrics_t metrics[METRICS_LENGTH];
+    FT_UInt line_height;
+    FT_UInt line_low; // Distance from the baseline to the bottom of the line
 
-    // TODO: check whether all of the uniforms were set at least once before the first
-    // call to ftr_draw; panic otherwise
+    GLuint program[FTP_COUNT];
+    GLint uniforms[FTP_COUNT][FTU_COUNT];
+    enum ft_program current_program;
 } ft_renderer_t;
 
 void ftr_free(ft_renderer_t *ftr);
-bool ftr_init(ft_renderer_t *ftr, FT_Face face);
+bool ftr_init(
+        ft_renderer_t *ftr, char const *font_path, FT_UInt pixel_size, pool_t *pool);
 
 void ftr_draw(ft_renderer_t *ftr);
 
+void ftr_layer_free(ftr_layer_t *layer);
+// Move the glyphs queued by `ftr_render_text` into `layer`
+void ftr_layer_store(ft_renderer_t *ftr, ftr_layer_t *layer);
+void ftr_layer_draw(ft_renderer_t *ftr, ftr_layer_t const *layer);
+
+// `text` is UTF-8. A sequence cut off at the end of `text` is drawn as a fallback glyph,
+// so text split in chunks has to be split on codepoint boundaries.
 v2f_t ftr_render_text(
         ft_renderer_t *ftr, char const *text, size_t text_size, v2f_t pos, v4f_t color);
 
-v2f_t ftr_cursor_pos(ft_renderer_t *ftr, char const *text, size_t text_size);
+// Queue the glyphs of `text` that aren't cached yet, to be rasterized together by
+// `ftr_prefetch` instead of one at a time as they are drawn
+void ftr_request(ft_renderer_t *ftr, char const *text, size_t text_size);
+void ftr_prefetch(ft_renderer_t *ftr);
 
-float ftr_get_max_line_width(ft_renderer_t *ftr, char const *text, size_t text_size);
+v2f_t ftr_cursor_pos(ft_renderer_t *ftr, char const *text, size_t text_size, v2f_t pos);
 
-float ftr_char_width(ft_renderer_t *ftr, char c);
+float ftr_char_width(ft_renderer_t *ftr, uint32_t codepoint);
 
-void ftr_use(ft_renderer_t *ftr, enum ft_program p);
+// Changes whenever glyph indices are reused, which invalidates stored layers
+size_t ftr_generation(ft_renderer_t const *ftr);
 
-#define ftr_set(ftr, u, p) \
-    _Generic(p, float: ftr_set_float, v2f_t: ftr_set_v2f)(ftr, u, p)
-void ftr_set_float(ft_renderer_t *ftr, enum ft_uniform u, float f);
-void ftr_set_v2f(ft_renderer_t *ftr, enum ft_uniform u, v2f_t v);
+void ftr_use(ft_renderer_t *ftr, enum ft_program p);
 
 #endif // FREETYPE_RENDERER_H_
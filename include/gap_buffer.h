@@ -0,0 +1,32 @@
+#ifndef GAP_BUFFER_H_
+#define GAP_BUFFER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "str.h"
+
+// Text is stored as [data, gap_start) ++ [gap_end, capacity). Edits move the gap to the
+// edit point first, so consecutive edits at the cursor only touch the edited bytes.
+typedef struct {
+    char *data;
+    size_t capacity;
+    size_t gap_start;
+    size_t gap_end;
+} gb_t;
+
+void gb_free(gb_t *gb);
+
+size_t gb_length(gb_t const *gb);
+char gb_at(gb_t const *gb, size_t index);
+
+void gb_insert(gb_t *gb, char const *data, size_t length, size_t index);
+void gb_remove(gb_t *gb, size_t length, size_t index);
+
+// Longest contiguous run of text starting at (resp. ending at) `index`
+strview_t gb_chunk(gb_t const *gb, size_t index);
+strview_t gb_chunk_rev(gb_t const *gb, size_t index);
+
+void gb_load_file(gb_t *gb, FILE *fp);
+
+#endif // GAP_BUFFER_H_
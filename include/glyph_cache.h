@@ -0,0 +1,127 @@
+#ifndef GLYPH_CACHE_H_
+#define GLYPH_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <freetype2/ft2build.h>
+#include FT_FREETYPE_H
+
+#include "da.h"
+#include "pool.h"
+
+#define GC_DIRECT_SIZE 256 // Codepoints below this skip the hash table
+#define GC_FALLBACK    0   // Glyph drawn for codepoints the font has no glyph for
+
+typedef struct {
+    float ax; // advance.x
+    float ay; // advance.y
+    float bw; // bitmap.width;
+    float bh; // bitmap.rows;
+    float bl; // bitmap_left;
+    float bt; // bitmap_top;
+    float tx; // x offset of glyph in the atlas, in pixels
+    float ty; // y offset of glyph in the atlas, in pixels
+} ft_glyph_metrics_t;
+
+typedef struct {
+    uint32_t codepoint;
+    uint32_t glyph; // Glyph index plus one, 0 for an empty slot
+} gc_entry_t;
+
+// Row of the atlas glyphs are packed into from left to right
+typedef struct {
+    GLsizei y;
+    GLsizei height;
+    GLsizei x;
+} gc_shelf_t;
+
+typedef struct {
+    FT_Library library;
+    FT_Face face;
+} gc_worker_t;
+
+// Glyphs are rasterized the first time their codepoint is drawn or measured and packed
+// into shelves of a single atlas page. The page doubles in height when no shelf fits a
+// glyph; once it can't grow anymore `gc_glyph` fails and the caller evicts everything
+// with `gc_clear`, after which glyph indices are reused.
+//
+// The whole cache can be saved to disk and is loaded back on the next start when the
+// font file and the rasterization parameters are unchanged. FreeType is only loaded once
+// a glyph is missing.
+typedef struct {
+    char const *font_path;
+    FT_UInt pixel_size;
+    FT_Library library;
+    FT_Face face; // Opened on the first miss
+
+    pool_t *pool;
+    gc_worker_t *workers; // Faces for the pool's workers, except for worker 0 which uses `face`
+    da(uint32_t) requests;
+
+    int ascender;  // Line metrics in pixels, rounded up
+    int descender; // Distance below the baseline, positive
+
+    char *cache_path; // NULL when there is nowhere to save the cache
+    bool loaded;      // The cache was read from disk
+    bool dirty;       // Glyphs were added since the cache was loaded
+
+    da(ft_glyph_metrics_t) metrics; // Indexed by glyph
+    da(uint32_t) codepoints;        // Codepoint each glyph was rasterized for
+
+    uint32_t direct[GC_DIRECT_SIZE]; // Same as gc_entry_t.glyph
+    gc_entry_t *table;               // Open addressing, for the remaining codepoints
+    size_t table_capacity;
+    size_t table_length;
+
+    // The atlas is mirrored in memory so that it can be regrown without reading it back
+    GLuint atlas;
+    unsigned char *pixels;
+    GLsizei atlas_w;
+    GLsizei atlas_h;
+    GLsizei atlas_max_h;
+    da(gc_shelf_t) shelves;
+
+    // Texture buffer with two texels per glyph: (bl, bt, bw, bh) and (tx, ty, bw, bh)
+    GLuint glyph_buffer;
+    GLuint glyph_texture;
+    size_t glyph_capacity;
+
+    size_t generation; // Incremented by `gc_clear`
+
+    size_t prefetch_count;   // Glyphs requested through `gc_prefetch`
+    double prefetch_seconds; // Time spent in `gc_prefetch`
+} glyph_cache_t;
+
+void gc_free(glyph_cache_t *gc);
+// `pool` rasterizes batches of glyphs; NULL rasterizes everything on the calling thread
+void gc_init(glyph_cache_t *gc, char const *font_path, FT_UInt pixel_size, pool_t *pool);
+
+// Find the glyph for `codepoint`, rasterizing it on first use. Returns false when the
+// atlas is full.
+bool gc_glyph(glyph_cache_t *gc, uint32_t codepoint, uint32_t *glyph);
+
+// Queue `codepoint` for `gc_prefetch` unless it is cached already
+void gc_request(glyph_cache_t *gc, uint32_t codepoint);
+
+// Rasterize the requested glyphs on the pool and upload them together. Glyphs that don't
+// fit in the atlas anymore are left for `gc_glyph`.
+void gc_prefetch(glyph_cache_t *gc);
+
+// Evict every glyph except for GC_FALLBACK
+void gc_clear(glyph_cache_t *gc);
+
+// Write the cache to disk if glyphs were added since it was loaded
+bool gc_save(glyph_cache_t const *gc);
+
+// Bind the atlas to texture unit 0 and the glyph table to texture unit 1
+void gc_bind(glyph_cache_t const *gc);
+
+static inline ft_glyph_metrics_t const *gc_metrics(glyph_cache_t const *gc, uint32_t glyph)
+{
+    return &gc->metrics.data[glyph];
+}
+
+#endif // GLYPH_CACHE_H_
@@ -0,0 +1,54 @@
+#ifndef LINE_INDEX_H_
+#define LINE_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "da.h"
+
+// Lines are kept in an implicit treap ordered by row, where every node stores the byte
+// length of its line (including the trailing '\n'). Subtree sums give row -> offset and
+// offset -> row in O(log n), and an edit only replaces the lines it touched.
+//
+// Nodes also hold the rendered width of their line, which the renderer measures on
+// demand. Lines replaced by an edit start out unmeasured, so widths stay valid for every
+// line that wasn't touched.
+typedef struct {
+    uint32_t left;
+    uint32_t right;
+    uint32_t priority;
+    size_t length;
+    size_t sum;   // Bytes in the subtree
+    size_t count; // Lines in the subtree
+
+    float width;         // Negative until measured
+    float max_width;     // Widest measured line in the subtree
+    uint32_t unmeasured; // Lines in the subtree without a width
+} line_node_t;
+
+typedef struct {
+    da(line_node_t) nodes; // nodes.data[0] is the nil node
+    da(uint32_t) unused;
+    uint32_t root;
+    uint32_t seed;
+} line_index_t;
+
+void li_free(line_index_t *li);
+
+// An empty index holds a single empty line
+size_t li_line_count(line_index_t const *li);
+size_t li_line_start(line_index_t const *li, size_t row);
+size_t li_line_length(line_index_t const *li, size_t row);
+size_t li_row(line_index_t const *li, size_t offset);
+
+void li_set_width(line_index_t *li, size_t row, float width);
+// Widest measured line among rows [first, last]
+float li_max_width(line_index_t const *li, size_t first, size_t last);
+// First unmeasured row at or after `row`, or the line count if there is none
+size_t li_unmeasured(line_index_t const *li, size_t row);
+
+// Replace rows [first, last] with `count` lines of the given lengths
+void li_replace(
+        line_index_t *li, size_t first, size_t last, size_t const *lengths, size_t count);
+
+#endif // LINE_INDEX_H_
@@ -0,0 +1,51 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "buffer.h"
+#include "file_view.h"
+#include "str.h"
+
+// Reads a file on a background thread. Regular files on local file systems are mapped
+// and handed over at once; anything else, like pipes or files on network file systems,
+// is read in growing chunks so that the first screen arrives early. The owner moves what
+// was read into its buffer with `ld_poll`, typically once per frame.
+typedef struct {
+    pthread_t thread;
+    bool running; // The thread was started and hasn't been joined yet
+    char *path;
+    atomic_bool cancel;
+
+    // Guarded by `mutex`
+    pthread_mutex_t mutex;
+    str_t pending; // Read but not handed over yet
+    fv_t view;     // Mapping of the whole file, if it could be mapped
+    size_t size;   // Size of the file when it was opened, 0 when unknown
+    size_t read;   // Bytes read so far
+    bool done;
+    int error; // errno of the failure, 0 otherwise
+
+    // Valid once `ld_poll` returned false
+    bool regular;
+    struct stat stat;
+} loader_t;
+
+// Stops loading, dropping whatever wasn't handed over yet
+void ld_free(loader_t *ld);
+void ld_start(loader_t *ld, char const *path);
+
+// Append everything read since the last call to `b`. Returns whether there is more to
+// come; once it returns false `error` tells whether the file was read completely.
+bool ld_poll(loader_t *ld, buffer_t *b);
+// Wait for the rest of the file and append it to `b`
+void ld_finish(loader_t *ld, buffer_t *b);
+
+// Fraction of the file read so far, or a negative number when the size is unknown
+float ld_progress(loader_t *ld);
+
+#endif // LOADER_H_
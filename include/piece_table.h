@@ -0,0 +1,54 @@
+#ifndef PIECE_TABLE_H_
+#define PIECE_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "da.h"
+#include "str.h"
+
+// A piece references an immutable run of bytes, either in the original file or in the
+// append-only add blocks. Bytes are never moved once written, so edits only shuffle
+// pieces around.
+typedef struct {
+    char const *data;
+    size_t length;
+    size_t start; // Logical offset of the piece in the text
+} piece_t;
+
+typedef struct {
+    da(piece_t) pieces;
+    size_t length;
+
+    char *original;
+    size_t original_length;
+    bool mapped;
+
+    da(char *) blocks;
+    size_t block_used;
+    size_t block_capacity;
+} pt_t;
+
+void pt_free(pt_t *pt);
+
+size_t pt_length(pt_t const *pt);
+char pt_at(pt_t const *pt, size_t index);
+
+void pt_insert(pt_t *pt, char const *data, size_t length, size_t index);
+void pt_remove(pt_t *pt, size_t length, size_t index);
+// Insert pieces for bytes that outlive the table's edits, such as text the table held
+// before, without copying them
+void pt_insert_spans(pt_t *pt, strview_t const *spans, size_t count, size_t index);
+
+strview_t pt_chunk(pt_t const *pt, size_t index);
+strview_t pt_chunk_rev(pt_t const *pt, size_t index);
+
+void pt_load_file(pt_t *pt, FILE *fp);
+// Take over a read-only mapping of `length` bytes as the original text, without copying
+void pt_load_mapping(pt_t *pt, char *data, size_t length);
+// Copy the bytes in [start, start + length) of a mapped original text that pieces still
+// reference into the add blocks, so that the file can be overwritten there
+void pt_detach(pt_t *pt, size_t start, size_t length);
+
+#endif // PIECE_TABLE_H_
@@ -0,0 +1,43 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Runs `index` = 0..count-1 of a batch, on the thread numbered `worker`
+typedef void (*pool_fn)(void *ctx, size_t worker, size_t index);
+
+// Fixed set of threads that split batches of independent items between them. The thread
+// calling `pool_run` takes part as worker 0, so there are `thread_count + 1` workers and
+// a zeroed pool runs everything on the calling thread.
+typedef struct {
+    pthread_t *threads;
+    size_t thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    size_t batch; // Incremented for every batch, so sleeping threads notice new work
+    size_t busy;  // Threads that haven't finished the current batch yet
+    bool quit;
+
+    pool_fn fn;
+    void *ctx;
+    size_t count;
+    atomic_size_t next;
+} pool_t;
+
+void pool_free(pool_t *pool);
+void pool_init(pool_t *pool, size_t workers);
+
+static inline size_t pool_workers(pool_t const *pool)
+{
+    return pool->thread_count + 1;
+}
+
+// Returns once every item of the batch is done
+void pool_run(pool_t *pool, size_t count, pool_fn fn, void *ctx);
+
+#endif // POOL_H_
@@ -5,12 +5,38 @@
 
 #include <GL/glew.h>
 
+#include "la.h"
+
+// Binding point of the `Frame` uniform block that holds the state shared by every
+// program. Programs declaring the block are bound to it when they are linked.
+#define FRAME_BLOCK_BINDING 0
+
+// std140 layout of the `Frame` block
+typedef struct {
+    v2f_t camera;
+    v2f_t resolution;
+    float scale;
+    float time;
+    float padding[2];
+} frame_uniforms_t;
+
 bool program_object_link(
         GLuint *program, char const **vert_filenames, size_t vert_filename_count,
         char const **frag_filenames, size_t frag_filename_count);
 
+// Resolve uniform locations once, so that setting them later needs no name lookups
+void program_object_locate(
+        GLuint program, char const *const *uniform_names, size_t uniform_count,
+        GLint *locations);
+
 void program_object_use(GLuint program);
-void program_object_uniform1f(GLuint program, char const *uniform_name, float f);
-void program_object_uniform2f(GLuint program, char const *uniform_name, float f, float g);
+void program_object_uniform1i(GLint location, int i);
+void program_object_uniform1f(GLint location, float f);
+void program_object_uniform2f(GLint location, float f, float g);
+
+void program_object_frame_init(GLuint *ubo);
+void program_object_frame_free(GLuint ubo);
+void program_object_frame_update(GLuint ubo, frame_uniforms_t const *frame);
+void program_object_frame_bind(GLuint ubo);
 
 #endif // PROGRAM_OBJECT_H_
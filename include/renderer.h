@@ -3,9 +3,12 @@
 
 #include <GL/glew.h>
 
+#include "da.h"
 #include "la.h"
+#include "stream.h"
 
-#define RENDERER_VERTICES_CAP 1024 * 1024
+// Most vertices uploaded by a single draw call; a multiple of 6 so quads are never split
+#define RENDERER_CHUNK_VERTICES (6 * 64 * 1024)
 
 typedef struct {
     v2f_t uv;
@@ -15,9 +18,8 @@ typedef struct {
 
 typedef struct {
     GLuint vao;
-    GLuint vbo;
-    vertex_t vertices[RENDERER_VERTICES_CAP];
-    size_t vertex_count;
+    stream_t stream;
+    da(vertex_t) vertices;
 } renderer_t;
 
 void renderer_free(renderer_t *r);
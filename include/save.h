@@ -0,0 +1,49 @@
+#ifndef SAVE_H_
+#define SAVE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "buffer.h"
+
+// Writes a buffer snapshot on a background thread. The text goes to a temporary file in
+// the same directory, which is synced and then renamed over the target, so the target
+// holds either the old or the new text even if the editor or the machine crashes.
+//
+// When only a few ranges changed and the length stayed the same, those ranges can be
+// written in place instead. That costs time proportional to the edits rather than the
+// file, at the price of the atomicity.
+typedef struct {
+    pthread_t thread;
+    bool running; // The thread was started and hasn't been joined yet
+    atomic_bool done;
+
+    char *path;
+    buffer_snapshot_t snapshot;
+    buffer_ranges_t ranges; // Where each span goes for in-place saves
+    bool in_place;
+    size_t length; // Bytes to write
+
+    // Valid once joined
+    char const *failed; // Step that failed, NULL on success
+    int error;          // errno of the failed step
+    double seconds;     // Time spent writing, syncing and renaming
+    struct stat stat;   // Of the saved file
+} save_t;
+
+void save_free(save_t *s);
+// Takes ownership of `snapshot`
+void save_start(save_t *s, char const *path, buffer_snapshot_t *snapshot);
+// Write the spans of `snapshot` over the ranges of `path`. Takes ownership of both.
+void save_start_in_place(
+        save_t *s, char const *path, buffer_snapshot_t *snapshot,
+        buffer_ranges_t *ranges);
+
+// Returns whether the save is still running; joins the thread once it is done
+bool save_poll(save_t *s);
+void save_wait(save_t *s);
+
+#endif // SAVE_H_
@@ -0,0 +1,67 @@
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buffer.h"
+#include "da.h"
+#include "pool.h"
+#include "str.h"
+
+#define SEARCH_SPAN        (1 << 20) // Bytes scanned per task
+#define SEARCH_MATCHES_MAX (1 << 16) // Matches kept by `search_range`
+
+typedef da(size_t) search_matches_t;
+typedef da(strview_t) search_spans_t;
+
+// Find every occurrence of `needle` in `b`, overlapping ones included, and store their
+// starts in increasing order. The text is split into spans that the workers of `pool`
+// scan independently, each reading up to `needle_length - 1` bytes into the next span.
+void search_all(
+        pool_t *pool, buffer_t const *b, char const *needle, size_t needle_length,
+        search_matches_t *out);
+// Same for the occurrences that start in [start, end), keeping the first
+// SEARCH_MATCHES_MAX of them
+void search_range(
+        pool_t *pool, buffer_t const *b, char const *needle, size_t needle_length,
+        size_t start, size_t end, search_matches_t *out);
+
+// Index into `matches` of the first match that starts at or after `index`
+size_t search_lower_bound(search_matches_t const *matches, size_t index);
+
+// Runs `search_all` on a background thread, so that finding every match of a large
+// buffer doesn't hold up the frames. The text is read where the buffer keeps it, without
+// a copy, so the buffer must be neither edited nor freed until the search is joined or
+// freed. Starting another search cancels the running one.
+typedef struct {
+    pthread_t thread;
+    bool running; // The thread was started and hasn't been joined yet
+    atomic_bool done;
+    atomic_bool cancel;
+
+    pool_t *pool; // Used by nothing else while the search runs, NULL for a single thread
+    search_spans_t spans; // Chunks of the buffer
+    size_t version;       // Of the buffer
+    str_t needle;
+
+    // Valid once joined
+    bool complete; // `matches` holds every match, the search wasn't canceled
+    search_matches_t matches;
+} search_t;
+
+void search_free(search_t *s);
+void search_start(
+        search_t *s, pool_t *pool, buffer_t const *b, char const *needle,
+        size_t needle_length);
+// Returns whether the search is still running; joins the thread once it is done
+bool search_poll(search_t *s);
+void search_wait(search_t *s);
+// Whether the last search started looks for `needle` in version `version` of a buffer.
+// Its matches are there once it is `complete`.
+bool search_started(
+        search_t const *s, size_t version, char const *needle, size_t needle_length);
+
+#endif // SEARCH_H_
@@ -38,7 +38,23 @@ typedef struct {
     size_t length;
 } strview_t;
 
+enum simd {
+    SIMD_UNKNOWN,
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX2,
+};
+
+// Vector instructions `sv_count_char` and `sv_find` use: the widest the CPU supports, up
+// to the limit, which is only lowered to compare them
+enum simd sv_simd_level(void);
+void sv_simd_limit(enum simd level);
+
 strview_t sv_from_str(str_t const *str);
+// Vectorized with the widest instructions the CPU supports
+size_t sv_count_char(strview_t sv, char c);
+// Index of the first occurrence of `needle`, or `sv.length` when there is none
+size_t sv_find(strview_t sv, char const *needle, size_t needle_length);
 size_t sv_cspn(strview_t sv, char const *reject);
 bool sv_token_subcstr(strview_t *sv, char const *subcstr, strview_t *out);
 bool sv_token_cspn(strview_t *sv, char const *c, strview_t *out);
@@ -0,0 +1,38 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#define STREAM_REGIONS 3
+
+enum stream_mode {
+    STREAM_RING,    // Unsynchronized writes into a fenced ring of regions
+    STREAM_ORPHAN,  // Orphan the buffer before every upload
+    STREAM_SUBDATA, // Plain glBufferSubData into the same storage
+    STREAM_MODE_COUNT,
+};
+
+// Vertex buffer for data that is regenerated every frame. In ring mode the buffer is
+// split into STREAM_REGIONS regions; uploads are appended to the current region and the
+// next region is only reused once the GPU has signalled the fence placed after its last
+// draw, so the CPU never writes memory the GPU may still be reading.
+typedef struct {
+    GLuint vbo;
+    size_t region_size;
+    size_t region;
+    size_t offset;
+    GLsync fences[STREAM_REGIONS];
+} stream_t;
+
+extern enum stream_mode stream_mode;
+
+void stream_free(stream_t *s);
+void stream_init(stream_t *s, size_t region_size);
+
+// Upload `size` bytes and return their offset in `s->vbo`, which stays bound to
+// GL_ARRAY_BUFFER
+size_t stream_push(stream_t *s, void const *data, size_t size);
+
+#endif // STREAM_H_
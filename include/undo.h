@@ -0,0 +1,93 @@
+#ifndef UNDO_H_
+#define UNDO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buffer.h"
+#include "da.h"
+#include "str.h"
+
+#define UNDO_BLOCK_SIZE     (64 * 1024) // Arena block, longer texts get one of their own
+#define UNDO_DEFAULT_BUDGET (64 << 20)
+#define UNDO_COALESCE_MAX   20 // Self-inserts or deletions merged into a single record
+
+enum undo_kind {
+    UNDO_INSERT,
+    UNDO_REMOVE,
+};
+
+typedef struct {
+    char *data;
+    size_t used;
+    size_t capacity;
+} undo_block_t;
+
+// Arena position, everything allocated after it can be released at once
+typedef struct {
+    size_t block;
+    size_t used;
+} undo_mark_t;
+
+typedef struct {
+    enum undo_kind kind;
+    size_t index; // Where the text was inserted or removed
+    size_t length;
+    size_t span; // Spans [span, span + span_count) hold the text
+    size_t span_count;
+    size_t group;     // Records of a group are undone and redone together
+    size_t edits;     // Edits coalesced into this record
+    bool coalesce;    // Later self-inserts or deletions may be merged into this record
+    undo_mark_t mark; // Arena position before the record was added
+} undo_record_t;
+
+// Journal of the edits of a buffer. The text of every edit is kept so that it can be
+// both undone and redone: stable buffers (see `buffer_stable`) are referenced in place,
+// the text of other buffers is copied into an arena. Undoing the deletion of a large
+// range of a piece table only puts its pieces back.
+//
+// Once the journal holds more than `budget` bytes, the oldest groups are dropped. A group
+// that doesn't fit in the budget on its own drops the whole journal.
+typedef struct {
+    da(undo_record_t) records;
+    da(strview_t) spans;
+    da(undo_block_t) blocks;
+    size_t arena; // Bytes allocated for blocks
+
+    size_t current; // Records before it are applied, the ones from it on were undone
+    size_t group;   // Of the last record
+    bool open;      // No boundary since the last record
+    undo_mark_t pinned; // End of the text copied by `undo_detach`, kept on truncation
+
+    size_t budget;
+} undo_t;
+
+void undo_free(undo_t *u);
+void undo_init(undo_t *u, size_t budget);
+// Forget every edit, e.g. because the buffer was replaced
+void undo_clear(undo_t *u);
+
+// End the current group, e.g. because the cursor moved: later self-inserts and deletions
+// no longer extend its last record
+void undo_boundary(undo_t *u);
+// Record an insertion right after it happened, resp. a removal right before it happens.
+// With `coalesce`, a self-insert or deletion right next to the previous one extends it
+// if there was no boundary in between, and starts a group otherwise. Other records join
+// the group open since the last boundary.
+void undo_record(
+        undo_t *u, buffer_t const *b, enum undo_kind kind, size_t index, size_t length,
+        bool coalesce);
+
+// Revert the last group, resp. reapply the last reverted one, and move `cursor` to where
+// the edit happened. Return false if there is nothing to undo or redo.
+bool undo_undo(undo_t *u, buffer_t *b, size_t *cursor);
+bool undo_redo(undo_t *u, buffer_t *b, size_t *cursor);
+
+// Copy the text the journal references in [data, data + length) into the arena, so that
+// the memory there can be overwritten
+void undo_detach(undo_t *u, char const *data, size_t length);
+
+// Bytes held by the journal
+size_t undo_used(undo_t const *u);
+
+#endif // UNDO_H_
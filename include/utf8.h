@@ -0,0 +1,29 @@
+#ifndef UTF8_H_
+#define UTF8_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTF8_MAX_LENGTH  4
+#define UTF8_REPLACEMENT 0xfffd
+
+static inline bool utf8_is_continuation(char c)
+{
+    return ((unsigned char) c & 0xc0) == 0x80;
+}
+
+// Length of the sequence started by `lead`, 1 for bytes that can't start one
+size_t utf8_sequence_length(char lead);
+
+// Decode the codepoint at the start of `text`, returning the amount of bytes it takes.
+// Malformed or truncated sequences decode to UTF8_REPLACEMENT and take one byte.
+size_t utf8_decode(char const *text, size_t text_size, uint32_t *codepoint);
+
+// Returns the amount of bytes written, 0 when `codepoint` can't be encoded
+size_t utf8_encode(uint32_t codepoint, char out[UTF8_MAX_LENGTH]);
+
+// Amount of bytes at the end of `text` that start a sequence it does not complete
+size_t utf8_incomplete_tail(char const *text, size_t text_size);
+
+#endif // UTF8_H_
@@ -7,9 +7,12 @@ layout(location = 2) in vec4 l_color;
 out vec2 p_uv;
 out vec4 p_color;
 
-uniform float u_scale;
-uniform vec2 u_camera;
-uniform vec2 u_resolution;
+layout(std140) uniform Frame {
+    vec2 u_camera;
+    vec2 u_resolution;
+    float u_scale;
+    float u_time;
+};
 
 vec2 project(vec2 point)
 {
@@ -4,7 +4,13 @@
 #define PERIOD 0.5
 #define M_PI 3.14159
 
-uniform float u_time;
+layout(std140) uniform Frame {
+    vec2 u_camera;
+    vec2 u_resolution;
+    float u_scale;
+    float u_time;
+};
+
 uniform float u_time_moved;
 
 in vec4 p_color;
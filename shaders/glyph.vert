@@ -0,0 +1,38 @@
+#version 330 core
+
+// Per glyph instance
+layout(location = 0) in vec2 l_pos;
+layout(location = 1) in uint l_glyph;
+layout(location = 2) in uint l_color;
+
+out vec2 p_uv;
+out vec4 p_color;
+
+layout(std140) uniform Frame {
+    vec2 u_camera;
+    vec2 u_resolution;
+    float u_scale;
+    float u_time;
+};
+
+uniform samplerBuffer u_glyphs;
+uniform sampler2D image; // The atlas, shared with the fragment shader
+
+vec2 project(vec2 point)
+{
+    return 2.0 * (point - u_camera) * u_scale / u_resolution;
+}
+
+void main() {
+    // (bl, bt, bw, bh) followed by the glyph's rect in the atlas, in pixels
+    vec4 box = texelFetch(u_glyphs, int(2u * l_glyph));
+    vec4 rect = texelFetch(u_glyphs, int(2u * l_glyph + 1u));
+
+    // Drawn as a 4 vertex triangle strip
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 pos = l_pos + vec2(box.x + corner.x * box.z, box.y - corner.y * box.w);
+
+    p_uv = (rect.xy + corner * rect.zw) / vec2(textureSize(image, 0));
+    p_color = vec4((uvec4(l_color) >> uvec4(0u, 8u, 16u, 24u)) & 0xffu) / 255.0;
+    gl_Position = vec4(project(pos), 0.0, 1.0);
+}
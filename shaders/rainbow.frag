@@ -1,8 +1,13 @@
 #version 330 core
 
 uniform sampler2D image;
-uniform float u_time;
-uniform vec2 u_resolution;
+
+layout(std140) uniform Frame {
+    vec2 u_camera;
+    vec2 u_resolution;
+    float u_scale;
+    float u_time;
+};
 
 in vec2 p_uv;
 in vec4 p_color;
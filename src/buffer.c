@@ -0,0 +1,815 @@
+#define _GNU_SOURCE
+
+#include "buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib.h"
+
+#define BUFFER_INDEX_STEP (256 * 1024) // Bytes scanned at a time when looking for a row
+#define BUFFER_DIRTY_MAX  1024         // Dirty ranges are merged into one past this
+
+static size_t buffer_generation = 0;
+
+static void buffer_index_insert(
+        buffer_t *b, char const *data, size_t length, size_t index);
+static void buffer_index_remove(buffer_t *b, size_t length, size_t index);
+static void buffer_index_tail(buffer_t *b, size_t length);
+static void buffer_index_reset(buffer_t *b);
+static void buffer_index_scan(buffer_t *b, size_t end);
+static void buffer_promote(buffer_t *b);
+static void buffer_insert_text(
+        buffer_t *b, char const *data, size_t length, size_t index);
+static void buffer_dirty_replace(
+        buffer_t *b, size_t index, size_t removed, size_t inserted);
+static void buffer_dirty_record(
+        buffer_dirty_list_t *dirty, size_t index, size_t removed, size_t inserted);
+
+void buffer_free(buffer_t *b)
+{
+    li_free(&b->lines);
+    da_free(&b->dirty);
+    da_free(&b->unsaved);
+    switch (b->kind) {
+        case BUFFER_GAP:
+            gb_free(&b->gb);
+            break;
+        case BUFFER_PIECE:
+            pt_free(&b->pt);
+            break;
+        case BUFFER_VIEW:
+            fv_free(&b->fv);
+            break;
+        default:
+            panic("Unreachable");
+    }
+    *b = (buffer_t) { 0 };
+}
+
+void buffer_init(buffer_t *b, enum buffer_kind kind)
+{
+    assert(0 <= kind && kind < BUFFER_KIND_COUNT);
+    *b = (buffer_t) { .kind = kind, .edit_kind = kind };
+}
+
+void buffer_init_view(buffer_t *b, enum buffer_kind edit_kind)
+{
+    assert(0 <= edit_kind && edit_kind < BUFFER_KIND_COUNT && edit_kind != BUFFER_VIEW);
+    *b = (buffer_t) { .kind = BUFFER_VIEW, .edit_kind = edit_kind };
+}
+
+size_t buffer_length(buffer_t const *b)
+{
+    switch (b->kind) {
+        case BUFFER_GAP:
+            return gb_length(&b->gb);
+        case BUFFER_PIECE:
+            return pt_length(&b->pt);
+        case BUFFER_VIEW:
+            return fv_length(&b->fv);
+        default:
+            panic("Unreachable");
+    }
+}
+
+char buffer_at(buffer_t const *b, size_t index)
+{
+    switch (b->kind) {
+        case BUFFER_GAP:
+            return gb_at(&b->gb, index);
+        case BUFFER_PIECE:
+            return pt_at(&b->pt, index);
+        case BUFFER_VIEW:
+            return fv_at(&b->fv, index);
+        default:
+            panic("Unreachable");
+    }
+}
+
+void buffer_insert(buffer_t *b, char const *data, size_t length, size_t index)
+{
+    buffer_dirty_replace(b, index, 0, length);
+    buffer_insert_text(b, data, length, index);
+}
+
+// Text past the last dirty range matches the file with a constant shift, so appended
+// text lines up with where it was read from. The last line spans everything past the
+// indexed part, so appended text joins it and is left for buffer_index_step, as the
+// text of a mapped file is
+void buffer_append_loaded(buffer_t *b, char const *data, size_t length)
+{
+    size_t index = buffer_length(b);
+    buffer_promote(b);
+    b->version = ++buffer_generation;
+    buffer_index_tail(b, length);
+    switch (b->kind) {
+        case BUFFER_GAP:
+            gb_insert(&b->gb, data, length, index);
+            break;
+        case BUFFER_PIECE:
+            pt_insert(&b->pt, data, length, index);
+            break;
+        default:
+            panic("Unreachable");
+    }
+}
+
+static void buffer_insert_text(
+        buffer_t *b, char const *data, size_t length, size_t index)
+{
+    buffer_promote(b);
+    b->version = ++buffer_generation;
+    buffer_index_to(b, index);
+    buffer_index_insert(b, data, length, index);
+    b->indexed += length;
+    switch (b->kind) {
+        case BUFFER_GAP:
+            gb_insert(&b->gb, data, length, index);
+            break;
+        case BUFFER_PIECE:
+            pt_insert(&b->pt, data, length, index);
+            break;
+        default:
+            panic("Unreachable");
+    }
+}
+
+void buffer_insert_spans(
+        buffer_t *b, strview_t const *spans, size_t count, size_t index)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        length += spans[i].length;
+    }
+    buffer_dirty_replace(b, index, 0, length);
+    buffer_promote(b);
+    if (b->kind != BUFFER_PIECE) {
+        for (size_t i = 0; i < count; i++) {
+            buffer_insert_text(b, spans[i].data, spans[i].length, index);
+            index += spans[i].length;
+        }
+        return;
+    }
+    b->version = ++buffer_generation;
+    buffer_index_to(b, index);
+    if (b->indexed == index) {
+        // Text restored into the part that isn't indexed yet is left for the scan
+        buffer_index_tail(b, length);
+    } else {
+        for (size_t i = 0, at = index; i < count; at += spans[i].length, i++) {
+            buffer_index_insert(b, spans[i].data, spans[i].length, at);
+        }
+        b->indexed += length;
+    }
+    pt_insert_spans(&b->pt, spans, count, index);
+}
+
+void buffer_remove(buffer_t *b, size_t length, size_t index)
+{
+    buffer_dirty_replace(b, index, length, 0);
+    buffer_promote(b);
+    b->version = ++buffer_generation;
+    buffer_index_to(b, index);
+    if (b->indexed <= index + length) {
+        // Nothing indexed survives past `index`, the rest is only scanned when needed
+        size_t row = buffer_row(b, index);
+        size_t line_length = buffer_length(b) - length - buffer_line_start(b, row);
+        li_replace(&b->lines, row, buffer_line_count(b) - 1, &line_length, 1);
+        b->indexed = index;
+    } else {
+        buffer_index_remove(b, length, index);
+        b->indexed -= length;
+    }
+    switch (b->kind) {
+        case BUFFER_GAP:
+            gb_remove(&b->gb, length, index);
+            break;
+        case BUFFER_PIECE:
+            pt_remove(&b->pt, length, index);
+            break;
+        default:
+            panic("Unreachable");
+    }
+}
+
+strview_t buffer_chunk(buffer_t const *b, size_t index)
+{
+    switch (b->kind) {
+        case BUFFER_GAP:
+            return gb_chunk(&b->gb, index);
+        case BUFFER_PIECE:
+            return pt_chunk(&b->pt, index);
+        case BUFFER_VIEW:
+            return fv_chunk(&b->fv, index);
+        default:
+            panic("Unreachable");
+    }
+}
+
+strview_t buffer_chunk_rev(buffer_t const *b, size_t index)
+{
+    switch (b->kind) {
+        case BUFFER_GAP:
+            return gb_chunk_rev(&b->gb, index);
+        case BUFFER_PIECE:
+            return pt_chunk_rev(&b->pt, index);
+        case BUFFER_VIEW:
+            return fv_chunk_rev(&b->fv, index);
+        default:
+            panic("Unreachable");
+    }
+}
+
+void buffer_slice(buffer_t const *b, str_t *out, size_t index, size_t length)
+{
+    assert(index + length <= buffer_length(b));
+    while (length > 0) {
+        strview_t chunk = buffer_chunk(b, index);
+        size_t n = min(chunk.length, length);
+        str_push(out, chunk.data, n);
+        index += n;
+        length -= n;
+    }
+}
+
+size_t buffer_line_count(buffer_t const *b)
+{
+    return li_line_count(&b->lines);
+}
+
+size_t buffer_line_start(buffer_t const *b, size_t row)
+{
+    return li_line_start(&b->lines, row);
+}
+
+size_t buffer_line_length(buffer_t const *b, size_t row)
+{
+    return li_line_length(&b->lines, row);
+}
+
+size_t buffer_row(buffer_t const *b, size_t index)
+{
+    return li_row(&b->lines, index);
+}
+
+void buffer_set_line_width(buffer_t *b, size_t row, float width)
+{
+    li_set_width(&b->lines, row, width);
+}
+
+float buffer_max_line_width(buffer_t const *b, size_t first, size_t last)
+{
+    return li_max_width(&b->lines, first, last);
+}
+
+size_t buffer_unmeasured_line(buffer_t const *b, size_t row)
+{
+    return li_unmeasured(&b->lines, row);
+}
+
+void buffer_index_to(buffer_t *b, size_t index)
+{
+    buffer_index_scan(b, index);
+}
+
+void buffer_index_rows(buffer_t *b, size_t row)
+{
+    // Row `row` is exact once the newline ending it has been seen
+    while (!buffer_indexed(b) && buffer_line_count(b) <= row + 1) {
+        buffer_index_scan(b, b->indexed + BUFFER_INDEX_STEP);
+    }
+}
+
+bool buffer_index_step(buffer_t *b, size_t bytes)
+{
+    buffer_index_scan(b, b->indexed + bytes);
+    return buffer_indexed(b);
+}
+
+bool buffer_indexed(buffer_t const *b)
+{
+    return b->indexed == buffer_length(b);
+}
+
+size_t buffer_find_char(buffer_t const *b, char c, size_t index)
+{
+    size_t length = buffer_length(b);
+    while (index < length) {
+        strview_t chunk = buffer_chunk(b, index);
+        char const *p = memchr(chunk.data, c, chunk.length);
+        if (p != NULL) {
+            return index + (p - chunk.data);
+        }
+        index += chunk.length;
+    }
+    return length;
+}
+
+// Same contract as `str_find_char_rev`: returns the index of the last `c` before `index`,
+// or 0 when there is none
+size_t buffer_find_char_rev(buffer_t const *b, char c, size_t index)
+{
+    assert(index <= buffer_length(b));
+    while (index > 0) {
+        strview_t chunk = buffer_chunk_rev(b, index);
+        char const *p = memrchr(chunk.data, c, chunk.length);
+        if (p != NULL) {
+            return index - chunk.length + (p - chunk.data);
+        }
+        index -= chunk.length;
+    }
+    return 0;
+}
+
+size_t buffer_count(buffer_t const *b, char c, size_t index)
+{
+    size_t length = buffer_length(b);
+    assert(index <= length);
+    size_t count = 0;
+    while (index < length) {
+        strview_t chunk = buffer_chunk(b, index);
+        count += sv_count_char(chunk, c);
+        index += chunk.length;
+    }
+    return count;
+}
+
+size_t buffer_count_rev(buffer_t const *b, char c, size_t index)
+{
+    assert(index <= buffer_length(b));
+    size_t count = 0;
+    while (index > 0) {
+        strview_t chunk = buffer_chunk_rev(b, index);
+        count += sv_count_char(chunk, c);
+        index -= chunk.length;
+    }
+    return count;
+}
+
+static bool buffer_match(
+        buffer_t const *b, size_t index, char const *needle, size_t needle_length)
+{
+    if (index + needle_length > buffer_length(b)) {
+        return false;
+    }
+    while (needle_length > 0) {
+        strview_t chunk = buffer_chunk(b, index);
+        size_t n = min(chunk.length, needle_length);
+        if (memcmp(chunk.data, needle, n) != 0) {
+            return false;
+        }
+        needle += n;
+        needle_length -= n;
+        index += n;
+    }
+    return true;
+}
+
+size_t buffer_search(
+        buffer_t const *b, char const *needle, size_t needle_length, size_t index)
+{
+    return buffer_search_before(b, needle, needle_length, index, buffer_length(b));
+}
+
+size_t buffer_search_before(
+        buffer_t const *b, char const *needle, size_t needle_length, size_t index,
+        size_t end)
+{
+    size_t length = buffer_length(b);
+    end = min(end, length);
+    if (needle_length == 0) {
+        return min(index, end);
+    }
+    // Matches starting before `end` may run up to `needle_length - 1` bytes past it
+    size_t limit = min(end + needle_length - 1, length);
+    while (index < end && index + needle_length <= limit) {
+        strview_t chunk = buffer_chunk(b, index);
+        chunk.length = min(chunk.length, limit - index);
+        char const *end_chunk = chunk.data + chunk.length;
+        size_t found = sv_find(chunk, needle, needle_length);
+        if (found < chunk.length) {
+            return index + found;
+        }
+        // Matches starting this close to the end of the chunk continue in the next ones
+        char const *p = chunk.data;
+        if (chunk.length >= needle_length) {
+            p = end_chunk - needle_length + 1;
+        }
+        while ((p = memchr(p, needle[0], end_chunk - p)) != NULL) {
+            size_t at = index + (p - chunk.data);
+            if (at >= end) {
+                return end;
+            }
+            if (buffer_match(b, at, needle, needle_length)) {
+                return at;
+            }
+            p++;
+        }
+        index += chunk.length;
+    }
+    return end;
+}
+
+size_t buffer_search_rev(
+        buffer_t const *b, char const *needle, size_t needle_length, size_t index)
+{
+    size_t length = buffer_length(b);
+    if (needle_length == 0 || needle_length > length) {
+        return length;
+    }
+    // There is no memrmem, so candidates are found by their first byte
+    index = min(index, length - needle_length + 1);
+    while (index > 0) {
+        strview_t chunk = buffer_chunk_rev(b, index);
+        char const *end = chunk.data + chunk.length;
+        char const *p;
+        while ((p = memrchr(chunk.data, needle[0], end - chunk.data)) != NULL) {
+            size_t at = index - chunk.length + (p - chunk.data);
+            if (buffer_match(b, at, needle, needle_length)) {
+                return at;
+            }
+            end = p;
+        }
+        index -= chunk.length;
+    }
+    return length;
+}
+
+void buffer_load_file(buffer_t *b, FILE *fp)
+{
+    b->version = ++buffer_generation;
+    if (b->kind == BUFFER_VIEW && !fv_load_file(&b->fv, fp)) {
+        // Nothing to map, e.g. an empty file or a pipe
+        b->kind = b->edit_kind;
+    }
+    switch (b->kind) {
+        case BUFFER_GAP:
+            gb_load_file(&b->gb, fp);
+            break;
+        case BUFFER_PIECE:
+            pt_load_file(&b->pt, fp);
+            break;
+        case BUFFER_VIEW:
+            break;
+        default:
+            panic("Unreachable");
+    }
+    buffer_index_reset(b);
+}
+
+void buffer_load_view(buffer_t *b, fv_t *fv)
+{
+    if (b->kind == BUFFER_VIEW && buffer_length(b) == 0) {
+        b->version = ++buffer_generation;
+        b->fv = *fv;
+        *fv = (fv_t) { 0 };
+        buffer_index_reset(b);
+    } else {
+        buffer_append_loaded(b, fv->data, fv->length);
+        fv_free(fv);
+    }
+}
+
+void buffer_write_file(buffer_t const *b, FILE *fp)
+{
+    size_t length = buffer_length(b);
+    for (size_t index = 0; index < length;) {
+        strview_t chunk = buffer_chunk(b, index);
+        fwrite(chunk.data, sizeof *chunk.data, chunk.length, fp);
+        index += chunk.length;
+    }
+}
+
+// Piece tables only ever append bytes, and views become piece tables without moving the
+// mapping
+bool buffer_stable(buffer_t const *b)
+{
+    return b->kind == BUFFER_PIECE ||
+           (b->kind == BUFFER_VIEW && b->edit_kind == BUFFER_PIECE);
+}
+
+strview_t buffer_mapping(buffer_t const *b)
+{
+    switch (b->kind) {
+        case BUFFER_PIECE:
+            if (b->pt.mapped) {
+                return (strview_t) { b->pt.original, b->pt.original_length };
+            }
+            return (strview_t) { 0 };
+        case BUFFER_VIEW:
+            return (strview_t) { b->fv.data, b->fv.length };
+        default:
+            return (strview_t) { 0 };
+    }
+}
+
+void buffer_snapshot(buffer_t const *b, buffer_snapshot_t *out)
+{
+    *out = (buffer_snapshot_t) { .length = buffer_length(b) };
+    if (!buffer_stable(b)) {
+        out->copy = malloc(out->length);
+        for (size_t index = 0; index < out->length;) {
+            strview_t chunk = buffer_chunk(b, index);
+            memcpy(out->copy + index, chunk.data, chunk.length);
+            index += chunk.length;
+        }
+        strview_t span = { .data = out->copy, .length = out->length };
+        da_push(&out->spans, &span);
+        return;
+    }
+    for (size_t index = 0; index < out->length;) {
+        strview_t chunk = buffer_chunk(b, index);
+        da_push(&out->spans, &chunk);
+        index += chunk.length;
+    }
+}
+
+void buffer_snapshot_free(buffer_snapshot_t *snapshot)
+{
+    da_free(&snapshot->spans);
+    free(snapshot->copy);
+    *snapshot = (buffer_snapshot_t) { 0 };
+}
+
+void buffer_snapshot_ranges(
+        buffer_t const *b, buffer_range_t const *ranges, size_t count,
+        buffer_snapshot_t *out)
+{
+    *out = (buffer_snapshot_t) { 0 };
+    for (size_t i = 0; i < count; i++) {
+        out->length += ranges[i].length;
+    }
+    out->copy = malloc(out->length);
+    char *p = out->copy;
+    for (size_t i = 0; i < count; i++) {
+        strview_t span = { .data = p, .length = ranges[i].length };
+        da_push(&out->spans, &span);
+        size_t end = ranges[i].start + ranges[i].length;
+        for (size_t index = ranges[i].start; index < end;) {
+            strview_t chunk = buffer_chunk(b, index);
+            size_t n = min(chunk.length, end - index);
+            memcpy(p, chunk.data, n);
+            p += n;
+            index += n;
+        }
+    }
+}
+
+void buffer_save_start(buffer_t *b)
+{
+    b->saving = true;
+    b->unsaved.length = 0;
+}
+
+void buffer_save_end(buffer_t *b, bool saved)
+{
+    if (saved) {
+        buffer_dirty_list_t dirty = b->dirty;
+        b->dirty = b->unsaved;
+        b->unsaved = dirty;
+    }
+    b->saving = false;
+    b->unsaved.length = 0;
+}
+
+bool buffer_modified(buffer_t const *b)
+{
+    return b->dirty.length > 0;
+}
+
+bool buffer_dirty_ranges(buffer_t const *b, size_t file_length, buffer_ranges_t *out)
+{
+    if (buffer_length(b) != file_length) {
+        return false;
+    }
+    // Consecutive ranges whose length differences cancel out are written as one, along
+    // with the clean text between them, which is shifted in the file
+    ptrdiff_t shift = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < b->dirty.length; i++) {
+        buffer_dirty_t const *d = &b->dirty.data[i];
+        if (shift == 0) {
+            start = d->start;
+        }
+        shift += (ptrdiff_t) d->length - (ptrdiff_t) d->file_length;
+        if (shift == 0) {
+            buffer_range_t range = {
+                .start = start,
+                .length = d->start + d->length - start,
+            };
+            da_push(out, &range);
+        }
+    }
+    assert(shift == 0);
+    return true;
+}
+
+void buffer_detach(buffer_t *b, size_t start, size_t length)
+{
+    // Views are never dirty and gap buffers own their text
+    if (b->kind == BUFFER_PIECE) {
+        pt_detach(&b->pt, start, length);
+    }
+}
+
+// Turn a view into an editable buffer. The piece table keeps reading from the mapping,
+// the gap buffer needs its own copy of the text.
+static void buffer_promote(buffer_t *b)
+{
+    if (b->kind != BUFFER_VIEW) {
+        return;
+    }
+    fv_t fv = b->fv;
+    size_t length = fv.length;
+    b->kind = b->edit_kind;
+    switch (b->kind) {
+        case BUFFER_GAP:
+            b->gb = (gb_t) { 0 };
+            if (length > 0) {
+                gb_insert(&b->gb, fv.data, length, 0);
+            }
+            fv_free(&fv);
+            break;
+        case BUFFER_PIECE:
+            b->pt = (pt_t) { 0 };
+            if (length > 0) {
+                pt_load_mapping(&b->pt, fv_release(&fv), length);
+            }
+            break;
+        default:
+            panic("Unreachable");
+    }
+}
+
+bool buffer_readdir(buffer_t *b, char const *dirname, size_t *out_entry_count)
+{
+    str_t entries = { 0 };
+    if (!str_readdir(&entries, dirname, out_entry_count)) {
+        return false;
+    }
+    buffer_push(b, entries.data, entries.length);
+    str_free(&entries);
+    return true;
+}
+
+// Record that `removed` bytes at `index` were replaced by `inserted` bytes, also against
+// the text being saved if a save runs
+static void buffer_dirty_replace(
+        buffer_t *b, size_t index, size_t removed, size_t inserted)
+{
+    if (removed == 0 && inserted == 0) {
+        return;
+    }
+    buffer_dirty_record(&b->dirty, index, removed, inserted);
+    if (b->saving) {
+        buffer_dirty_record(&b->unsaved, index, removed, inserted);
+    }
+}
+
+// Every range that overlaps or touches the edit is merged into a single one
+static void buffer_dirty_record(
+        buffer_dirty_list_t *dirty, size_t index, size_t removed, size_t inserted)
+{
+    size_t lo = 0, hi = dirty->length;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        buffer_dirty_t const *d = &dirty->data[mid];
+        if (d->start + d->length < index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    size_t first = lo, last = lo;
+    size_t start = index, end = index + removed;
+    size_t dirty_length = 0, file_length = 0;
+    for (; last < dirty->length && dirty->data[last].start <= end; last++) {
+        buffer_dirty_t const *d = &dirty->data[last];
+        start = min(start, d->start);
+        end = max(end, d->start + d->length);
+        dirty_length += d->length;
+        file_length += d->file_length;
+    }
+    // Clean bytes in the merged range match the file one to one
+    buffer_dirty_t merged = {
+        .start = start,
+        .length = end - start - removed + inserted,
+        .file_length = file_length + (end - start - dirty_length),
+    };
+    if (last > first) {
+        da_remove_n(dirty, last - first - 1, first + 1);
+        dirty->data[first] = merged;
+    } else {
+        da_insert_n(dirty, &merged, 1, first);
+    }
+    for (size_t i = first + 1; i < dirty->length; i++) {
+        dirty->data[i].start = dirty->data[i].start - removed + inserted;
+    }
+
+    if (dirty->length > BUFFER_DIRTY_MAX) {
+        buffer_dirty_t *d = dirty->data;
+        size_t n = dirty->length;
+        buffer_dirty_t all = { .start = d[0].start };
+        size_t all_end = d[n - 1].start + d[n - 1].length;
+        all.length = all_end - all.start;
+        all.file_length = all.length;
+        for (size_t i = 0; i < n; i++) {
+            all.file_length = all.file_length - d[i].length + d[i].file_length;
+        }
+        dirty->length = 0;
+        da_push(dirty, &all);
+    }
+}
+
+// Line index maintenance. Must run before the text is modified, since removals need to
+// know which lines the removed range spans.
+
+// Grows the last line by text added past the indexed part without scanning it
+static void buffer_index_tail(buffer_t *b, size_t length)
+{
+    size_t row = buffer_line_count(b) - 1;
+    size_t line_length = buffer_line_length(b, row) + length;
+    li_replace(&b->lines, row, row, &line_length, 1);
+}
+
+static void buffer_index_insert(
+        buffer_t *b, char const *data, size_t length, size_t index)
+{
+    size_t row = buffer_row(b, index);
+    size_t start = buffer_line_start(b, row);
+    size_t end = start + buffer_line_length(b, row);
+
+    da(size_t) lengths = { 0 };
+    size_t line_start = start;
+    char const *p = data;
+    char const *data_end = data + length;
+    while ((p = memchr(p, '\n', data_end - p)) != NULL) {
+        p++;
+        size_t line_end = index + (p - data);
+        size_t line_length = line_end - line_start;
+        da_push(&lengths, &line_length);
+        line_start = line_end;
+    }
+    size_t last_length = end + length - line_start;
+    da_push(&lengths, &last_length);
+
+    li_replace(&b->lines, row, row, lengths.data, lengths.length);
+    da_free(&lengths);
+}
+
+static void buffer_index_remove(buffer_t *b, size_t length, size_t index)
+{
+    size_t first = buffer_row(b, index);
+    size_t last = buffer_row(b, index + length);
+    size_t start = buffer_line_start(b, first);
+    size_t end = buffer_line_start(b, last) + buffer_line_length(b, last);
+    size_t merged_length = end - start - length;
+    li_replace(&b->lines, first, last, &merged_length, 1);
+}
+
+// Start over with a single line spanning the whole text
+static void buffer_index_reset(buffer_t *b)
+{
+    size_t length = buffer_length(b);
+    li_free(&b->lines);
+    li_replace(&b->lines, 0, 0, &length, 1);
+    b->indexed = 0;
+}
+
+// Split the last line at the newlines in [indexed, end)
+static void buffer_index_scan(buffer_t *b, size_t end)
+{
+    size_t length = buffer_length(b);
+    end = min(end, length);
+    if (b->indexed >= end) {
+        return;
+    }
+
+    size_t row = buffer_line_count(b) - 1;
+    size_t line_start = buffer_line_start(b, row);
+    da(size_t) lengths = { 0 };
+    for (size_t index = b->indexed; index < end;) {
+        strview_t chunk = buffer_chunk(b, index);
+        size_t n = min(chunk.length, end - index);
+        char const *p = chunk.data;
+        char const *chunk_end = chunk.data + n;
+        while ((p = memchr(p, '\n', chunk_end - p)) != NULL) {
+            p++;
+            size_t line_end = index + (p - chunk.data);
+            size_t line_length = line_end - line_start;
+            da_push(&lengths, &line_length);
+            line_start = line_end;
+        }
+        index += n;
+    }
+    if (lengths.length > 0) {
+        size_t last_length = length - line_start;
+        da_push(&lengths, &last_length);
+        li_replace(&b->lines, row, row, lengths.data, lengths.length);
+    }
+    da_free(&lengths);
+    b->indexed = end;
+}
@@ -8,6 +8,8 @@ void cr_free(cursor_renderer_t *cr)
     glDeleteProgram(cr->program);
 }
 
+static char const *uniform_name(enum cursor_uniform u);
+
 bool cr_init(cursor_renderer_t *cr)
 {
     char const *vert_filename = "shaders/camera.vert";
@@ -15,6 +17,11 @@ bool cr_init(cursor_renderer_t *cr)
     if (!program_object_link(&cr->program, &vert_filename, 1, &frag_filename, 1)) {
         return false;
     }
+    char const *uniform_names[CU_COUNT];
+    for (enum cursor_uniform u = 0; u < CU_COUNT; u++) {
+        uniform_names[u] = uniform_name(u);
+    }
+    program_object_locate(cr->program, uniform_names, CU_COUNT, cr->uniforms);
     renderer_init(&cr->r);
     return true;
 }
@@ -30,33 +37,23 @@ void cr_use(cursor_renderer_t const *cr)
     program_object_use(cr->program);
 }
 
-static char const *uniform_name(enum cursor_uniform u);
-
 void cr_set_float(cursor_renderer_t const *cr, enum cursor_uniform u, float f)
 {
     cr_use(cr);
-    program_object_uniform1f(cr->program, uniform_name(u), f);
+    program_object_uniform1f(cr->uniforms[u], f);
 }
 
 void cr_set_v2f(cursor_renderer_t const *cr, enum cursor_uniform u, v2f_t v)
 {
     cr_use(cr);
-    program_object_uniform2f(cr->program, uniform_name(u), v2(v));
+    program_object_uniform2f(cr->uniforms[u], v2(v));
 }
 
 static char const *uniform_name(enum cursor_uniform u)
 {
     switch (u) {
-        case CU_TIME:
-            return "u_time";
         case CU_TIME_MOVED:
             return "u_time_moved";
-        case CU_SCALE:
-            return "u_scale";
-        case CU_CAMERA:
-            return "u_camera";
-        case CU_RESOLUTION:
-            return "u_resolution";
         default:
             panic("Unreachable");
     }
@@ -1,15 +1,28 @@
 #include "editor.h"
 
 #include "lib.h"
+#include "utf8.h"
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+static void editor_save_wait(editor_file_t *f);
+static editor_file_t *editor_new_file(editor_t *e);
+static void editor_evict(editor_t *e);
+
 void editor_free(editor_t *e)
 {
-    (void) e;
+    for (size_t i = 0; i < e->files.length; i++) {
+        editor_file_t *f = e->files.data[i];
+        editor_save_wait(f);
+        save_free(&f->save);
+        ld_free(&f->loader);
+        undo_free(&f->undo);
+    }
+    search_free(&e->search);
     debugf("%s[Not freeing editor...]\n", "");
 }
 
@@ -17,35 +30,81 @@ void editor_free(editor_t *e)
 // pointers
 void editor_new(editor_t *e)
 {
-    *e = (editor_t) { 0 };
-    e->buffer = &e->text_buffer;
-    e->cursor = &e->text_cursor;
+    *e = (editor_t) {
+        .memory = EDITOR_DEFAULT_MEMORY,
+        .undo_budget = UNDO_DEFAULT_BUDGET,
+    };
+    // Unnamed buffer shown until a file is loaded
+    e->file = editor_new_file(e);
+    e->buffer = &e->file->buffer;
+    e->cursor = &e->file->cursor;
 }
 
 // Movement
 
-void editor_forward_char(editor_t *e)
+// Typing after the cursor moved starts a new undo record. Motions of the minibuffer
+// leave the file's journal alone.
+static void editor_undo_boundary(editor_t *e)
 {
-    if (*e->cursor < e->buffer->length) {
-        *e->cursor+=1;
+    if (e->buffer == &e->file->buffer) {
+        undo_boundary(&e->file->undo);
     }
 }
 
-void editor_backward_char(editor_t *e)
+static size_t next_char_index(buffer_t const *b, size_t index)
 {
-    if (*e->cursor > 0) {
-        *e->cursor -= 1;
+    size_t length = buffer_length(b);
+    if (index < length) {
+        index++;
+    }
+    while (index < length && utf8_is_continuation(buffer_at(b, index))) {
+        index++;
     }
+    return index;
+}
+
+static size_t previous_char_index(buffer_t const *b, size_t index)
+{
+    if (index > 0) {
+        index--;
+    }
+    while (index > 0 && utf8_is_continuation(buffer_at(b, index))) {
+        index--;
+    }
+    return index;
+}
+
+// Index of the `col`th character after `start`, without going past `end`
+static size_t col_index(buffer_t const *b, size_t start, size_t end, size_t col)
+{
+    for (; col > 0 && start < end; col--) {
+        start = next_char_index(b, start);
+    }
+    return min(start, end);
+}
+
+void editor_forward_char(editor_t *e)
+{
+    editor_undo_boundary(e);
+    *e->cursor = next_char_index(e->buffer, *e->cursor);
+}
+
+void editor_backward_char(editor_t *e)
+{
+    editor_undo_boundary(e);
+    *e->cursor = previous_char_index(e->buffer, *e->cursor);
 }
 
 void editor_move_end_of_line(editor_t *e)
 {
-    *e->cursor = str_find_char(e->buffer, '\n', *e->cursor);
+    editor_undo_boundary(e);
+    *e->cursor = buffer_find_char(e->buffer, '\n', *e->cursor);
 }
 
 void editor_move_beginning_of_line(editor_t *e)
 {
-    size_t index = str_find_char_rev(e->buffer, '\n', *e->cursor);
+    editor_undo_boundary(e);
+    size_t index = buffer_find_char_rev(e->buffer, '\n', *e->cursor);
     *e->cursor = index + (index != 0);
 }
 
@@ -58,12 +117,8 @@ void editor_next_line(editor_t *e)
     editor_forward_char(e);
 
     // Move to target column
-    size_t line_length = str_find_char(e->buffer, '\n', *e->cursor) - *e->cursor;
-    if (line_length > target_col) {
-        *e->cursor += target_col;
-    } else {
-        *e->cursor += line_length;
-    }
+    size_t line_end = buffer_find_char(e->buffer, '\n', *e->cursor);
+    *e->cursor = col_index(e->buffer, *e->cursor, line_end, target_col);
 }
 
 void editor_previous_line(editor_t *e)
@@ -80,20 +135,26 @@ void editor_previous_line(editor_t *e)
     // before and after the `move_beginning_of_line` call
     if (cur != *e->cursor) {
         // Move to target column
-        size_t line_length = str_find_char(e->buffer, '\n', *e->cursor) - *e->cursor;
-        if (line_length > target_col) {
-            *e->cursor += target_col;
-        } else {
-            *e->cursor += line_length;
-        }
+        size_t line_end = buffer_find_char(e->buffer, '\n', *e->cursor);
+        *e->cursor = col_index(e->buffer, *e->cursor, line_end, target_col);
     }
 }
 
 // Editing
 
+// Only edits of the text buffer are journaled
+static void editor_record(
+        editor_t *e, enum undo_kind kind, size_t index, size_t length, bool coalesce)
+{
+    if (e->buffer == &e->file->buffer) {
+        undo_record(&e->file->undo, e->buffer, kind, index, length, coalesce);
+    }
+}
+
 static void editor_delete_selection(editor_t *e)
 {
     assert(e->mark_set);
+    editor_undo_boundary(e);
     size_t start, end;
     if (*e->cursor > e->mark) {
         start = e->mark;
@@ -102,18 +163,33 @@ static void editor_delete_selection(editor_t *e)
         start = *e->cursor;
         end = e->mark;
     }
-    str_remove(e->buffer, end - start, start);
+    editor_record(e, UNDO_REMOVE, start, end - start, false);
+    buffer_remove(e->buffer, end - start, start);
     *e->cursor = start;
     e->mark_set = false;
 }
 
+static void editor_changed(editor_t *e)
+{
+    if (e->buffer == &e->minibuffer && e->minichange != NULL) {
+        e->minichange(e);
+    }
+}
+
 void editor_insert(editor_t *e, char const *text, size_t text_size)
 {
+    // Typing over a selection or inserting more than a character is a command of its own
+    bool coalesce = !e->mark_set && text_size <= UTF8_MAX_LENGTH;
+    if (!coalesce) {
+        editor_undo_boundary(e);
+    }
     if (e->mark_set) {
         editor_delete_selection(e);
     }
-    str_insert(e->buffer, text, text_size, *e->cursor);
+    buffer_insert(e->buffer, text, text_size, *e->cursor);
+    editor_record(e, UNDO_INSERT, *e->cursor, text_size, coalesce);
     *e->cursor += text_size;
+    editor_changed(e);
 }
 
 void editor_self_insert(editor_t *e, char c)
@@ -125,10 +201,14 @@ void editor_delete_char(editor_t *e)
 {
     if (e->mark_set) {
         editor_delete_selection(e);
+        editor_changed(e);
         return;
     }
-    if (*e->cursor < e->buffer->length) {
-        str_remove(e->buffer, 1, *e->cursor);
+    size_t next = next_char_index(e->buffer, *e->cursor);
+    if (next > *e->cursor) {
+        editor_record(e, UNDO_REMOVE, *e->cursor, next - *e->cursor, true);
+        buffer_remove(e->buffer, next - *e->cursor, *e->cursor);
+        editor_changed(e);
     }
 }
 
@@ -136,10 +216,11 @@ void editor_delete_backward_char(editor_t *e)
 {
     if (e->mark_set) {
         editor_delete_selection(e);
+        editor_changed(e);
         return;
     }
     if (*e->cursor > 0) {
-        *e->cursor -= 1;
+        *e->cursor = previous_char_index(e->buffer, *e->cursor);
         editor_delete_char(e);
     }
 }
@@ -150,10 +231,35 @@ void editor_newline(editor_t *e)
     editor_self_insert(e, '\n');
 }
 
+static void editor_undo_apply(editor_t *e, bool redo)
+{
+    editor_file_t *f = e->file;
+    if (e->buffer != &f->buffer || e->fsnav) {
+        return;
+    }
+    e->mark_set = false;
+    bool applied = redo ? undo_redo(&f->undo, &f->buffer, &f->cursor)
+                        : undo_undo(&f->undo, &f->buffer, &f->cursor);
+    if (!applied) {
+        printf("[EDITOR] No further %s information\n", redo ? "redo" : "undo");
+    }
+}
+
+void editor_undo(editor_t *e)
+{
+    editor_undo_apply(e, false);
+}
+
+void editor_redo(editor_t *e)
+{
+    editor_undo_apply(e, true);
+}
+
 void editor_set_mark(editor_t *e)
 {
     // TODO: for now
     assert(!e->fsnav);
+    editor_undo_boundary(e);
     e->mark_set = true;
     e->mark = *e->cursor;
 }
@@ -169,8 +275,8 @@ editor_minibuffer_start(editor_t *e, char const *prompt, char const *placeholder
     if (placeholder == NULL) {
         placeholder = "";
     }
-    str_push_cstr(&e->minibuffer, placeholder);
-    e->minicursor = e->minibuffer.length;
+    buffer_push_cstr(&e->minibuffer, placeholder);
+    e->minicursor = buffer_length(&e->minibuffer);
     e->buffer = &e->minibuffer;
     e->cursor = &e->minicursor;
 }
@@ -180,62 +286,270 @@ void editor_minibuffer_terminate(editor_t *e)
     assert(e->mini);
     assert(e->minicallback != NULL);
     e->minicallback(e);
-    str_free(&e->minibuffer);
+    buffer_free(&e->minibuffer);
     e->minicursor = 0;
     e->mini = false;
-    // TODO: introduce alternate buffers
-    e->buffer = &e->text_buffer;
-    e->cursor = &e->text_cursor;
+    e->buffer = &e->file->buffer;
+    e->cursor = &e->file->cursor;
     e->minicallback = NULL;
+    e->minichange = NULL;
 }
 
 // I-Search
 
+#define ISEARCH_PROMPT         "I-Search: "
+#define ISEARCH_FAILING_PROMPT "Failing I-Search: "
+
+// Move to the first match at or after `index`, resp. the last one before it, wrapping
+// around the buffer if there is none
+static void editor_isearch_find(editor_t *e, size_t index, bool forward, bool wrap)
+{
+    str_t query = { 0 };
+    buffer_slice(&e->minibuffer, &query, 0, buffer_length(&e->minibuffer));
+    buffer_t const *b = &e->file->buffer;
+    size_t length = buffer_length(b);
+    size_t match;
+    if (forward) {
+        match = buffer_search(b, query.data, query.length, index);
+        if (match == length && wrap) {
+            match = buffer_search(b, query.data, query.length, 0);
+        }
+    } else {
+        match = buffer_search_rev(b, query.data, query.length, index);
+        if (match == length && wrap) {
+            match = buffer_search_rev(b, query.data, query.length, length);
+        }
+    }
+
+    e->search_found = match < length || query.length == 0;
+    if (e->search_found) {
+        e->search_match = query.length > 0 ? match : e->search_origin;
+        e->file->cursor = e->search_match;
+    }
+    e->miniprompt = e->search_found ? ISEARCH_PROMPT : ISEARCH_FAILING_PROMPT;
+    str_free(&e->search_query);
+    e->search_query = query;
+}
+
+// Matches of a longer query are also matches of the previous one, so the search resumes
+// from the current match instead of the origin. Searching backward, the current match
+// starts before `search_match + 1` and stays found if it still matches
+static void editor_isearch_update(editor_t *e)
+{
+    size_t length = buffer_length(&e->minibuffer);
+    bool extended = e->search_found && length >= e->search_query.length;
+    for (size_t i = 0; extended && i < e->search_query.length; i++) {
+        extended = buffer_at(&e->minibuffer, i) == e->search_query.data[i];
+    }
+    size_t index = e->search_origin;
+    if (extended) {
+        index = e->search_forward ? e->search_match : e->search_match + 1;
+    }
+    editor_isearch_find(e, index, e->search_forward, false);
+}
+
+static void editor_isearch_done(editor_t *e)
+{
+    str_free(&e->search_query);
+    // The search reads the text buffer, which can be edited from now on
+    search_free(&e->search);
+}
+
+bool editor_isearching(editor_t const *e)
+{
+    return e->mini && e->minichange == editor_isearch_update;
+}
+
+static void editor_isearch_start(editor_t *e, bool forward)
+{
+    // The search moves the cursor
+    undo_boundary(&e->file->undo);
+    editor_minibuffer_start(e, ISEARCH_PROMPT, NULL);
+    e->minicallback = editor_isearch_done;
+    e->minichange = editor_isearch_update;
+    e->search_origin = e->search_match = e->file->cursor;
+    e->search_found = true;
+    e->search_forward = forward;
+}
+
+bool editor_isearch_poll(editor_t *e)
+{
+    // The search reads the text in place, so it waits for the loader to stop appending
+    if (!editor_isearching(e) || e->file->loader.running) {
+        return false;
+    }
+    buffer_t const *b = &e->file->buffer;
+    str_t const *query = &e->search_query;
+    if (!search_started(&e->search, b->version, query->data, query->length)) {
+        search_start(&e->search, e->search_pool, b, query->data, query->length);
+    }
+    return search_poll(&e->search);
+}
+
+search_matches_t const *editor_isearch_matches(editor_t const *e)
+{
+    buffer_t const *b = &e->file->buffer;
+    str_t const *query = &e->search_query;
+    if (!editor_isearching(e) || !e->search.complete ||
+        !search_started(&e->search, b->version, query->data, query->length)) {
+        return NULL;
+    }
+    return &e->search.matches;
+}
+
 void editor_isearch(editor_t *e)
 {
-    editor_minibuffer_start(e, "I-Search: ", NULL);
+    if (!editor_isearching(e)) {
+        editor_isearch_start(e, true);
+        return;
+    }
+    e->search_forward = true;
+    editor_isearch_find(e, e->search_match + 1, true, true);
+}
+
+void editor_isearch_backward(editor_t *e)
+{
+    if (!editor_isearching(e)) {
+        editor_isearch_start(e, false);
+        return;
+    }
+    e->search_forward = false;
+    editor_isearch_find(e, e->search_match, false, true);
 }
 
 // File I/O
 
-void editor_load_file(editor_t *e, char const *filename)
+static void editor_read_file(editor_file_t *f, enum buffer_kind kind)
 {
-    e->buffer = &e->text_buffer;
-    e->cursor = &e->text_cursor;
+    // The contents show up over the next frames, see `editor_load_poll`
+    f->known = false;
+    buffer_free(&f->buffer);
+    buffer_init_view(&f->buffer, kind);
+    undo_clear(&f->undo);
+    ld_start(&f->loader, f->pathname.data);
+}
 
-    // Load file contents
-    FILE *fp = fopen(filename, "r");
-    if (fp == NULL) {
-        panic("Could not open file \"%s\": %s", filename, strerror(errno));
+// Open buffer of `pathname`; files are compared by inode, so that different paths to
+// the same file share a buffer
+static editor_file_t *editor_find_file(editor_t const *e, char const *pathname)
+{
+    struct stat filestat;
+    bool exists = stat(pathname, &filestat) == 0;
+    for (size_t i = 0; i < e->files.length; i++) {
+        editor_file_t *f = e->files.data[i];
+        if (exists && f->known && f->stat.st_dev == filestat.st_dev &&
+            f->stat.st_ino == filestat.st_ino) {
+            return f;
+        }
+        if (!str_isnull(&f->pathname) && strcmp(f->pathname.data, pathname) == 0) {
+            return f;
+        }
     }
-    str_free(&e->text_buffer);
-    str_load_file(&e->text_buffer, fp);
-    fclose(fp);
+    return NULL;
+}
 
-    str_free(&e->pathname);
+void editor_load_file(editor_t *e, char const *filename)
+{
+    str_t pathname = { 0 };
     if (*filename == '/') {
-        str_push_cstr(&e->pathname, filename);
+        str_push_cstr(&pathname, filename);
     } else {
         char cwd[512] = { 0 };
         getcwd(cwd, 512);
         cwd[strlen(cwd)] = '/';
-        str_push_cstr(&e->pathname, cwd);
-        str_push_cstr(&e->pathname, filename);
+        str_push_cstr(&pathname, cwd);
+        str_push_cstr(&pathname, filename);
     }
 
-    *e->cursor = 0;
+    editor_file_t *file = editor_find_file(e, pathname.data);
+    if (file != NULL) {
+        str_free(&pathname);
+        editor_switch(e, file);
+        return;
+    }
+    // An empty unnamed buffer is taken over instead of being left behind
+    for (size_t i = 0; i < e->files.length && file == NULL; i++) {
+        editor_file_t *f = e->files.data[i];
+        if (str_isnull(&f->pathname) && buffer_length(&f->buffer) == 0) {
+            file = f;
+        }
+    }
+    if (file == NULL) {
+        file = editor_new_file(e);
+    }
+    str_free(&file->pathname);
+    file->pathname = pathname;
+    file->cursor = 0;
+    editor_read_file(file, e->buffer_kind);
+    editor_switch(e, file);
+}
+
+static void editor_load_done(editor_file_t *f)
+{
+    if (f->loader.error != 0) {
+        panic("Could not read file \"%s\": %s", f->pathname.data,
+              strerror(f->loader.error));
+    }
+    f->known = f->loader.regular;
+    f->stat = f->loader.stat;
+    if (f->resume > 0) {
+        f->cursor = min(f->resume, buffer_length(&f->buffer));
+        f->resume = 0;
+    }
+}
+
+bool editor_load_poll(editor_t *e)
+{
+    bool loading = false;
+    bool loaded = false;
+    for (size_t i = 0; i < e->files.length; i++) {
+        editor_file_t *f = e->files.data[i];
+        if (!f->loader.running) {
+            continue;
+        }
+        if (ld_poll(&f->loader, &f->buffer)) {
+            loading = true;
+        } else {
+            editor_load_done(f);
+            loaded = true;
+        }
+    }
+    // The size of a file is only known once it was read
+    if (loaded) {
+        editor_evict(e);
+    }
+    return loading;
+}
+
+static void editor_load_finish(editor_file_t *f)
+{
+    if (f->loader.running) {
+        ld_finish(&f->loader, &f->buffer);
+        editor_load_done(f);
+    }
+}
+
+static bool same_file(struct stat const *a, struct stat const *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+           a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
 }
 
 static void editor_set_pathname(editor_t *e)
 {
-    str_free(&e->pathname);
-    str_push_cstr(&e->pathname, e->minibuffer.data);
+    str_free(&e->file->pathname);
+    buffer_slice(&e->minibuffer, &e->file->pathname, 0, buffer_length(&e->minibuffer));
     editor_save_buffer(e);
 }
 
 void editor_save_buffer(editor_t *e)
 {
-    if (str_isnull(&e->pathname)) {
+    editor_file_t *f = e->file;
+    if (f == &e->listing) {
+        return;
+    }
+    if (str_isnull(&f->pathname)) {
         char cwd[512] = { 0 };
         getcwd(cwd, 512);
         cwd[strlen(cwd)] = '/';
@@ -244,22 +558,207 @@ void editor_save_buffer(editor_t *e)
         return;
     }
 
+    // A partially loaded buffer must not replace the file
+    editor_load_finish(f);
+    editor_save_wait(f);
+
     struct stat filestat;
-    if (stat(e->pathname.data, &filestat) == -1 && ENOENT != errno) {
-        panic("Could not stat %s: %s\n", e->pathname.data, strerror(errno));
+    bool exists = stat(f->pathname.data, &filestat) == 0;
+    if (!exists && ENOENT != errno) {
+        panic("Could not stat %s: %s\n", f->pathname.data, strerror(errno));
+    }
+    if (exists && (filestat.st_mode & S_IFMT) != S_IFREG) {
+        panic("Not a regular file 0o%o: %s", (filestat.st_mode & S_IFMT),
+              f->pathname.data);
     }
 
-    if (ENOENT == errno || ((filestat.st_mode & S_IFMT) == S_IFREG)) {
-        FILE *fp = fopen(e->pathname.data, "w");
-        if (fp == NULL) {
-            panic("Could not open file \"%s\": %s\n", e->pathname.data, strerror(errno));
+    buffer_t *b = &f->buffer;
+    buffer_snapshot_t snapshot;
+    buffer_ranges_t ranges = { 0 };
+    bool unchanged = f->known && exists && same_file(&filestat, &f->stat);
+    if (unchanged && buffer_dirty_ranges(b, filestat.st_size, &ranges)) {
+        if (ranges.length == 0) {
+            printf("[EDITOR] No changes to save in \"%s\"\n", f->pathname.data);
+            return;
+        }
+        // Only the modified ranges are rewritten, nothing may keep referencing them
+        strview_t mapping = buffer_mapping(b);
+        for (size_t i = 0; i < ranges.length; i++) {
+            size_t start = ranges.data[i].start;
+            size_t length = ranges.data[i].length;
+            buffer_detach(b, start, length);
+            if (start < mapping.length) {
+                length = min(length, mapping.length - start);
+                undo_detach(&f->undo, mapping.data + start, length);
+            }
         }
-        str_write_file(&e->text_buffer, fp);
-        fclose(fp);
+        buffer_snapshot_ranges(b, ranges.data, ranges.length, &snapshot);
+        save_start_in_place(&f->save, f->pathname.data, &snapshot, &ranges);
     } else {
-        panic("Not a regular file 0o%o: %s", (filestat.st_mode & S_IFMT),
-              e->pathname.data);
+        // The file is replaced by a rename, so the buffer can keep reading from its
+        // mapping
+        buffer_snapshot(b, &snapshot);
+        save_start(&f->save, f->pathname.data, &snapshot);
+    }
+    // Edits from now on are also recorded against the text being written. The dirty
+    // ranges stay until the save succeeded, see `editor_save_done`.
+    buffer_save_start(b);
+    f->known = false;
+}
+
+static void editor_save_done(editor_file_t *f)
+{
+    save_t const *s = &f->save;
+    buffer_save_end(&f->buffer, s->failed == NULL);
+    if (s->failed != NULL) {
+        // The file may be partly written, so the next save replaces it as a whole
+        fprintf(stderr, "[EDITOR] Could not save \"%s\" (%s): %s\n", s->path, s->failed,
+                strerror(s->error));
+        return;
+    }
+    printf("[EDITOR] %s %zu bytes to \"%s\" in %.3fs\n",
+           s->in_place ? "Patched" : "Saved", s->length, s->path, s->seconds);
+    f->known = true;
+    f->stat = s->stat;
+}
+
+static void editor_save_wait(editor_file_t *f)
+{
+    if (f->save.running) {
+        save_wait(&f->save);
+        editor_save_done(f);
+    }
+}
+
+bool editor_save_poll(editor_t *e)
+{
+    bool saving = false;
+    for (size_t i = 0; i < e->files.length; i++) {
+        editor_file_t *f = e->files.data[i];
+        if (!f->save.running) {
+            continue;
+        }
+        if (save_poll(&f->save)) {
+            saving = true;
+        } else {
+            editor_save_done(f);
+        }
     }
+    return saving;
+}
+
+// Buffers
+
+static editor_file_t *editor_new_file(editor_t *e)
+{
+    editor_file_t *file = malloc(sizeof *file);
+    *file = (editor_file_t) { 0 };
+    undo_init(&file->undo, e->undo_budget);
+    da_push(&e->files, &file);
+    return file;
+}
+
+// Only buffers that can be read back as they are lose their text
+static bool editor_evictable(editor_t const *e, editor_file_t const *f)
+{
+    return f != e->file && !f->evicted && f->known && !f->loader.running &&
+           !f->save.running && !buffer_modified(&f->buffer);
+}
+
+static void editor_evict(editor_t *e)
+{
+    size_t memory = 0;
+    for (size_t i = 0; i < e->files.length; i++) {
+        memory += buffer_length(&e->files.data[i]->buffer);
+    }
+    while (memory > e->memory) {
+        editor_file_t *lru = NULL;
+        for (size_t i = 0; i < e->files.length; i++) {
+            editor_file_t *f = e->files.data[i];
+            if (editor_evictable(e, f) && (lru == NULL || f->used < lru->used)) {
+                lru = f;
+            }
+        }
+        if (lru == NULL) {
+            return;
+        }
+        memory -= buffer_length(&lru->buffer);
+        // The journal references the text
+        undo_clear(&lru->undo);
+        buffer_free(&lru->buffer);
+        lru->mark_set = false;
+        lru->evicted = true;
+    }
+}
+
+void editor_switch(editor_t *e, editor_file_t *file)
+{
+    // The buffer being searched may be evicted
+    search_free(&e->search);
+    e->file->mark_set = e->mark_set;
+    e->file->mark = e->mark;
+    e->file = file;
+    e->buffer = &file->buffer;
+    e->cursor = &file->cursor;
+    e->mark_set = file->mark_set;
+    e->mark = file->mark;
+    if (file == &e->listing) {
+        return;
+    }
+    e->fsnav = false;
+    file->used = ++e->clock;
+    if (file->evicted) {
+        file->evicted = false;
+        file->resume = file->cursor;
+        file->cursor = 0;
+        editor_read_file(file, e->buffer_kind);
+    }
+    editor_evict(e);
+}
+
+static int editor_compare_use(void const *a, void const *b)
+{
+    editor_file_t const *fa = *(editor_file_t *const *) a;
+    editor_file_t const *fb = *(editor_file_t *const *) b;
+    return fa->used < fb->used ? 1 : fa->used > fb->used ? -1 : 0;
+}
+
+// Open buffers, most recently shown first
+static void editor_files_by_use(editor_t const *e, editor_file_t ***out)
+{
+    *out = malloc(e->files.length * sizeof **out);
+    memcpy(*out, e->files.data, e->files.length * sizeof **out);
+    qsort(*out, e->files.length, sizeof **out, editor_compare_use);
+}
+
+void editor_list_buffers(editor_t *e)
+{
+    if (e->mini) {
+        return;
+    }
+    editor_file_t **files;
+    editor_files_by_use(e, &files);
+    editor_file_t *listing = &e->listing;
+    buffer_free(&listing->buffer);
+    for (size_t i = 0; i < e->files.length; i++) {
+        editor_file_t const *f = files[i];
+        char const *name = str_isnull(&f->pathname) ? "[No name]" : f->pathname.data;
+        buffer_push_cstr(&listing->buffer, name);
+        if (buffer_modified(&f->buffer)) {
+            buffer_push_cstr(&listing->buffer, " [Modified]");
+        }
+        buffer_push_cstr(&listing->buffer, "\n");
+    }
+    free(files);
+    e->fsnav_entry_count = e->files.length;
+    // The buffer shown before the current one, as the most likely pick
+    listing->cursor = 0;
+    editor_switch(e, listing);
+    if (e->files.length > 1) {
+        editor_next_line(e);
+    }
+    e->fsnav = true;
+    e->buffer_list = true;
 }
 
 /// fsnav functions
@@ -272,50 +771,78 @@ static void pathname_parent(str_t *pathname)
 
 static void editor_read_pathname(editor_t *e)
 {
-    printf("[EDITOR] Trying to read \"%s\"\n", e->pathname.data);
+    editor_file_t *listing = &e->listing;
+    printf("[EDITOR] Trying to read \"%s\"\n", listing->pathname.data);
     struct stat filestat;
-    if (stat(e->pathname.data, &filestat) == -1) {
-        panic("Could not stat %s: %s\n", e->pathname.data, strerror(errno));
+    if (stat(listing->pathname.data, &filestat) == -1) {
+        panic("Could not stat %s: %s\n", listing->pathname.data, strerror(errno));
     }
 
     switch (filestat.st_mode & S_IFMT) {
         case S_IFDIR:
-            str_free(&e->text_buffer);
-            if (!str_readdir(&e->text_buffer, e->pathname.data, &e->fsnav_entry_count)) {
+            buffer_free(&listing->buffer);
+            if (!buffer_readdir(
+                        &listing->buffer, listing->pathname.data,
+                        &e->fsnav_entry_count)) {
                 panic("Could not read directory: %s\n", strerror(errno));
             }
+            listing->cursor = 0;
+            editor_switch(e, listing);
             e->fsnav = true;
+            e->buffer_list = false;
             break;
         case S_IFREG:
-            editor_load_file(e, e->pathname.data);
-            e->fsnav = false;
+            editor_load_file(e, listing->pathname.data);
             break;
         default:
             panic("Unknown file type.");
     }
-    *e->cursor = 0;
 }
 
 void editor_fsnav(editor_t *e)
 {
-    if (str_isnull(&e->pathname)) {
-        str_push_cstr(&e->pathname, ".");
-    } else {
-        pathname_parent(&e->pathname);
+    if (e->mini) {
+        return;
     }
+    str_t *pathname = &e->listing.pathname;
+    if (e->file != &e->listing || e->buffer_list) {
+        // Start from the directory of the buffer shown
+        str_free(pathname);
+        if (str_isnull(&e->file->pathname)) {
+            str_push_cstr(pathname, ".");
+            editor_read_pathname(e);
+            return;
+        }
+        str_push(pathname, e->file->pathname.data, e->file->pathname.length);
+    }
+    pathname_parent(pathname);
     editor_read_pathname(e);
 }
 
 void editor_fsnav_find_file(editor_t *e)
 {
     editor_move_beginning_of_line(e);
-    size_t entry_length = strcspn(e->text_buffer.data + e->text_cursor, "\n");
-    if (strncmp(e->text_buffer.data + e->text_cursor, "..", entry_length) == 0) {
-        pathname_parent(&e->pathname);
+    if (e->buffer_list) {
+        size_t row = editor_get_cursor_row(e);
+        if (row < e->files.length) {
+            editor_file_t **files;
+            editor_files_by_use(e, &files);
+            editor_switch(e, files[row]);
+            free(files);
+        }
+        return;
+    }
+    size_t entry_length =
+            buffer_find_char(&e->file->buffer, '\n', e->file->cursor) - e->file->cursor;
+    str_t entry = { 0 };
+    buffer_slice(&e->file->buffer, &entry, e->file->cursor, entry_length);
+    if (strncmp(entry.data, "..", entry_length) == 0) {
+        pathname_parent(&e->file->pathname);
     } else {
-        str_push_cstr(&e->pathname, "/");
-        str_push(&e->pathname, e->text_buffer.data + e->text_cursor, entry_length);
+        str_push_cstr(&e->file->pathname, "/");
+        str_push(&e->file->pathname, entry.data, entry_length);
     }
+    str_free(&entry);
     editor_read_pathname(e);
 }
 
@@ -323,50 +850,55 @@ void editor_fsnav_find_file(editor_t *e)
 
 size_t editor_get_line_count(editor_t const *e)
 {
-    size_t line = 0;
-    for (size_t cursor = 0; cursor < e->text_buffer.length; cursor++) {
-        if (e->text_buffer.data[cursor] == '\n') {
-            line++;
-        }
-    }
-    return line;
+    return buffer_line_count(&e->file->buffer) - 1;
 }
 
 size_t editor_get_cursor_row(editor_t const *e)
 {
-    return str_count_rev(&e->text_buffer, '\n', e->text_cursor);
+    return buffer_row(&e->file->buffer, e->file->cursor);
 }
 
 size_t editor_get_cursor_col(editor_t const *e)
 {
-    size_t index = str_find_char_rev(&e->text_buffer, '\n', e->text_cursor);
-    return e->text_cursor - index - (index != 0);
+    size_t row = buffer_row(&e->file->buffer, e->file->cursor);
+    size_t col = 0;
+    for (size_t i = buffer_line_start(&e->file->buffer, row); i < e->file->cursor; i++) {
+        col += !utf8_is_continuation(buffer_at(&e->file->buffer, i));
+    }
+    return col;
 }
 
 void editor_get_cursor_line_boundaries(editor_t const *e, size_t *start, size_t *end)
 {
-    *start = str_find_char_rev(&e->text_buffer, '\n', e->text_cursor);
-    *end = str_find_char(&e->text_buffer, '\n', e->text_cursor);
+    *start = buffer_find_char_rev(&e->file->buffer, '\n', e->file->cursor);
+    *end = buffer_find_char(&e->file->buffer, '\n', e->file->cursor);
 }
 
-char editor_get_char(editor_t const *e)
+uint32_t editor_get_codepoint(editor_t const *e)
 {
-    if (e->text_cursor < e->text_buffer.length) {
-        return e->text_buffer.data[e->text_cursor];
+    size_t length = buffer_length(&e->file->buffer);
+    if (e->file->cursor >= length) {
+        return '\0';
+    }
+    char text[UTF8_MAX_LENGTH];
+    size_t n = min(length - e->file->cursor, (size_t) UTF8_MAX_LENGTH);
+    for (size_t i = 0; i < n; i++) {
+        text[i] = buffer_at(&e->file->buffer, e->file->cursor + i);
     }
-    return '\0';
+    uint32_t codepoint;
+    utf8_decode(text, n, &codepoint);
+    return codepoint;
 }
 
 size_t editor_nth_char_index(editor_t const *e, char c, size_t nth)
 {
+    size_t length = buffer_length(&e->file->buffer);
+    if (c == '\n') {
+        return min(buffer_line_start(&e->file->buffer, nth), length);
+    }
     size_t cursor = 0;
-    for (size_t char_nth = 0; cursor < e->text_buffer.length; cursor++) {
-        if (char_nth == nth) {
-            return cursor;
-        }
-        if (e->text_buffer.data[cursor] == c) {
-            char_nth++;
-        }
+    for (size_t char_nth = 0; char_nth < nth && cursor < length; char_nth++) {
+        cursor = buffer_find_char(&e->file->buffer, c, cursor) + 1;
     }
-    return cursor;
+    return min(cursor, length);
 }
@@ -0,0 +1,64 @@
+#include "file_view.h"
+
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void fv_free(fv_t *fv)
+{
+    if (fv->data != NULL) {
+        munmap(fv->data, fv->length);
+    }
+    *fv = (fv_t) { 0 };
+}
+
+size_t fv_length(fv_t const *fv)
+{
+    return fv->length;
+}
+
+char fv_at(fv_t const *fv, size_t index)
+{
+    assert(index < fv->length);
+    return fv->data[index];
+}
+
+strview_t fv_chunk(fv_t const *fv, size_t index)
+{
+    assert(index <= fv->length);
+    return (strview_t) { .data = fv->data + index, .length = fv->length - index };
+}
+
+strview_t fv_chunk_rev(fv_t const *fv, size_t index)
+{
+    assert(index <= fv->length);
+    return (strview_t) { .data = fv->data, .length = index };
+}
+
+bool fv_load_file(fv_t *fv, FILE *fp)
+{
+    assert(fv->data == NULL);
+
+    struct stat filestat;
+    int fd = fileno(fp);
+    if (fstat(fd, &filestat) != 0 || !S_ISREG(filestat.st_mode) ||
+        filestat.st_size <= 0) {
+        return false;
+    }
+    void *addr = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    // Text is mostly read front to back, from wherever the view is
+    madvise(addr, filestat.st_size, MADV_SEQUENTIAL);
+    fv->data = addr;
+    fv->length = filestat.st_size;
+    return true;
+}
+
+char *fv_release(fv_t *fv)
+{
+    char *data = fv->data;
+    *fv = (fv_t) { 0 };
+    return data;
+}
@@ -2,28 +2,47 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "lib.h"
 #include "program_object.h"
+#include "utf8.h"
 
-static void ftr_init_texture_atlas(ft_renderer_t *ftr, FT_Face face);
+enum glyph_attr {
+    GLYPH_ATTR_POS = 0,
+    GLYPH_ATTR_GLYPH,
+    GLYPH_ATTR_COLOR,
+};
+
+#define FTR_STREAM_SIZE (64 * 1024)
+#define FTR_SDF_SPREAD  8 // FreeType's default, in pixels on each side of a glyph
+
+static void ftr_init_instances(ft_renderer_t *ftr);
+static void ftr_bind_instances(ft_renderer_t *ftr, size_t offset);
+static void ftr_init_line_metrics(ft_renderer_t *ftr);
+static char const *uniform_name(enum ft_uniform ftu);
 
 void ftr_free(ft_renderer_t *ftr)
 {
-    renderer_free(&ftr->r);
-    glDeleteTextures(1, &ftr->atlas);
+    glDeleteVertexArrays(1, &ftr->vao);
+    stream_free(&ftr->stream);
+    da_free(&ftr->instances);
+    da_free(&ftr->requeue);
+    gc_free(&ftr->glyphs);
     for (enum ft_program p = 0; p < FTP_COUNT; p++) {
         glDeleteProgram(ftr->program[p]);
     }
 }
 
-bool ftr_init(ft_renderer_t *ftr, FT_Face face)
+bool ftr_init(
+        ft_renderer_t *ftr, char const *font_path, FT_UInt pixel_size, pool_t *pool)
 {
-    char const *vert_filename = "shaders/camera.vert";
+    char const *vert_filename = "shaders/glyph.vert";
     char const *rainbow_filename = "shaders/rainbow.frag";
     char const *image_filename = "shaders/image_red.frag";
 
-    renderer_init(&ftr->r);
+    ftr_init_instances(ftr);
 
     if (!program_object_link(
                 &ftr->program[FTP_RAINBOW], &vert_filename, 1, &rainbow_filename, 1) ||
@@ -31,85 +50,187 @@ bool ftr_init(ft_renderer_t *ftr, FT_Face face)
                 &ftr->program[FTP_COLOR], &vert_filename, 1, &image_filename, 1)) {
         return false;
     }
+    char const *uniform_names[FTU_COUNT];
+    for (enum ft_uniform u = 0; u < FTU_COUNT; u++) {
+        uniform_names[u] = uniform_name(u);
+    }
+    for (enum ft_program p = 0; p < FTP_COUNT; p++) {
+        program_object_locate(ftr->program[p], uniform_names, FTU_COUNT, ftr->uniforms[p]);
+        program_object_use(ftr->program[p]);
+        program_object_uniform1i(ftr->uniforms[p][FTU_GLYPHS], 1);
+    }
 
-    ftr_init_texture_atlas(ftr, face);
+    gc_init(&ftr->glyphs, font_path, pixel_size, pool);
+    ftr_init_line_metrics(ftr);
     ftr->current_program = -1;
     return true;
 }
 
-void ftr_draw(ft_renderer_t *ftr)
+static void ftr_bind_textures(ft_renderer_t *ftr)
 {
     ftr_use(ftr, ftr->current_program);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ftr->atlas);
-    renderer_draw(&ftr->r);
+    gc_bind(&ftr->glyphs);
+}
+
+void ftr_draw(ft_renderer_t *ftr)
+{
+    ftr_bind_textures(ftr);
+    if (ftr->instances.length == 0) {
+        return;
+    }
+    glBindVertexArray(ftr->vao);
+    size_t offset = stream_push(
+            &ftr->stream, ftr->instances.data,
+            ftr->instances.length * sizeof *ftr->instances.data);
+    ftr_bind_instances(ftr, offset);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) ftr->instances.length);
+    ftr->instances.length = 0;
+}
+
+void ftr_layer_free(ftr_layer_t *layer)
+{
+    glDeleteBuffers(1, &layer->vbo);
+    *layer = (ftr_layer_t) { 0 };
+}
+
+void ftr_layer_store(ft_renderer_t *ftr, ftr_layer_t *layer)
+{
+    if (layer->vbo == 0) {
+        glGenBuffers(1, &layer->vbo);
+    }
+    // Respecifying the storage orphans the copy the GPU may still be drawing from
+    glBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+    glBufferData(
+            GL_ARRAY_BUFFER, ftr->instances.length * sizeof *ftr->instances.data,
+            ftr->instances.data, GL_DYNAMIC_DRAW);
+    layer->count = ftr->instances.length;
+    ftr->instances.length = 0;
+}
+
+void ftr_layer_draw(ft_renderer_t *ftr, ftr_layer_t const *layer)
+{
+    ftr_bind_textures(ftr);
+    if (layer->count == 0) {
+        return;
+    }
+    glBindVertexArray(ftr->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+    ftr_bind_instances(ftr, 0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) layer->count);
+}
+
+static GLuint pack_color(v4f_t c)
+{
+    float const rgba[4] = { c.x, c.y, c.z, c.w };
+    GLuint packed = 0;
+    for (int i = 0; i < 4; i++) {
+        packed |= (GLuint) (max(0.0f, min(1.0f, rgba[i])) * 255.0f + 0.5f) << (8 * i);
+    }
+    return packed;
+}
+
+// The atlas is full: start over with only the glyphs of the text queued so far, so that
+// the instances already pushed stay valid
+static void ftr_evict(ft_renderer_t *ftr)
+{
+    ftr->requeue.length = 0;
+    for (size_t i = 0; i < ftr->instances.length; i++) {
+        da_push(&ftr->requeue, &ftr->glyphs.codepoints.data[ftr->instances.data[i].glyph]);
+    }
+    gc_clear(&ftr->glyphs);
+    for (size_t i = 0; i < ftr->instances.length; i++) {
+        uint32_t glyph;
+        if (!gc_glyph(&ftr->glyphs, ftr->requeue.data[i], &glyph)) {
+            glyph = GC_FALLBACK;
+        }
+        ftr->instances.data[i].glyph = glyph;
+    }
+}
+
+static uint32_t ftr_glyph(ft_renderer_t *ftr, uint32_t codepoint)
+{
+    uint32_t glyph;
+    if (gc_glyph(&ftr->glyphs, codepoint, &glyph)) {
+        return glyph;
+    }
+    ftr_evict(ftr);
+    if (gc_glyph(&ftr->glyphs, codepoint, &glyph)) {
+        return glyph;
+    }
+    return GC_FALLBACK;
 }
 
 v2f_t ftr_render_text(
         ft_renderer_t *ftr, char const *text, size_t text_size, v2f_t pos, v4f_t color)
 {
-    for (size_t i = 0; i < text_size; i++) {
+    GLuint packed = pack_color(color);
+    for (size_t i = 0; i < text_size;) {
         if (text[i] == '\n') {
-            pos.y -= ftr->atlas_h;
+            pos.y -= ftr->line_height;
             pos.x = 0;
+            i++;
             continue;
         }
 
-        ft_glyph_metrics_t metrics = ftr->metrics[(int) text[i]];
-        float x = metrics.bl + pos.x;
-        float y = metrics.bt + pos.y;
-        float w = metrics.bw;
-        float h = metrics.bh;
+        uint32_t codepoint;
+        i += utf8_decode(text + i, text_size - i, &codepoint);
+        uint32_t glyph = ftr_glyph(ftr, codepoint);
+        glyph_instance_t instance = {
+            .pos = pos,
+            .glyph = glyph,
+            .color = packed,
+        };
+        da_push(&ftr->instances, &instance);
 
-        pos.x += metrics.ax;
-        pos.y += metrics.ay;
-
-        renderer_image_rect(
-                &ftr->r, v2f(x, y), v2f(w, -h), v2f(metrics.tx, 0.0),
-                v2f(metrics.bw / ftr->atlas_w, metrics.bh / ftr->atlas_h), color);
+        ft_glyph_metrics_t const *gm = gc_metrics(&ftr->glyphs, glyph);
+        pos.x += gm->ax;
+        pos.y += gm->ay;
     }
     return pos;
 }
 
-v2f_t ftr_cursor_pos(ft_renderer_t *ftr, char const *text, size_t text_size)
+void ftr_request(ft_renderer_t *ftr, char const *text, size_t text_size)
+{
+    for (size_t i = 0; i < text_size;) {
+        uint32_t codepoint;
+        i += utf8_decode(text + i, text_size - i, &codepoint);
+        if (codepoint != '\n') {
+            gc_request(&ftr->glyphs, codepoint);
+        }
+    }
+}
+
+void ftr_prefetch(ft_renderer_t *ftr)
 {
-    v2f_t pos = v2fs(0.0);
-    for (size_t i = 0; i < text_size; i++) {
+    gc_prefetch(&ftr->glyphs);
+}
+
+v2f_t ftr_cursor_pos(ft_renderer_t *ftr, char const *text, size_t text_size, v2f_t pos)
+{
+    for (size_t i = 0; i < text_size;) {
         if (text[i] == '\n') {
-            pos.y -= ftr->atlas_h;
+            pos.y -= ftr->line_height;
             pos.x = 0;
+            i++;
             continue;
         }
-        ft_glyph_metrics_t metrics = ftr->metrics[(int) text[i]];
-        pos.x += metrics.ax;
-        pos.y += metrics.ay;
+        uint32_t codepoint;
+        i += utf8_decode(text + i, text_size - i, &codepoint);
+        ft_glyph_metrics_t const *gm = gc_metrics(&ftr->glyphs, ftr_glyph(ftr, codepoint));
+        pos.x += gm->ax;
+        pos.y += gm->ay;
     }
     return pos;
 }
 
-float ftr_get_max_line_width(ft_renderer_t *ftr, char const *text, size_t text_size)
+float ftr_char_width(ft_renderer_t *ftr, uint32_t codepoint)
 {
-    float width = 0;
-    float max_width = 0;
-    for (size_t cursor = 0; cursor < text_size; cursor++) {
-        if (text[cursor] == '\n') {
-            if (width > max_width) {
-                max_width = width;
-            }
-            width = 0;
-            continue;
-        }
-        width += ftr_char_width(ftr, text[cursor]);
-    }
-    if (width > max_width) {
-        max_width = width;
-    }
-    return max_width;
+    return gc_metrics(&ftr->glyphs, ftr_glyph(ftr, codepoint))->ax;
 }
 
-float ftr_char_width(ft_renderer_t *ftr, char c)
+size_t ftr_generation(ft_renderer_t const *ftr)
 {
-    return ftr->metrics[(int) c].ax;
+    return ftr->glyphs.generation;
 }
 
 void ftr_use(ft_renderer_t *ftr, enum ft_program p)
@@ -122,106 +243,54 @@ void ftr_use(ft_renderer_t *ftr, enum ft_program p)
     program_object_use(ftr->program[p]);
 }
 
-static char const *uniform_name(enum ft_uniform ftu);
-
-void ftr_set_float(ft_renderer_t *ftr, enum ft_uniform u, float f)
-{
-    ftr_use(ftr, ftr->current_program);
-    program_object_uniform1f(ftr->program[ftr->current_program], uniform_name(u), f);
-}
-
-void ftr_set_v2f(ft_renderer_t *ftr, enum ft_uniform u, v2f_t v)
+// Line metrics used to come from the tallest rasterized ASCII glyph. They are taken from
+// the face instead, so that they are known before anything is rasterized.
+static void ftr_init_line_metrics(ft_renderer_t *ftr)
 {
-    ftr_use(ftr, ftr->current_program);
-    program_object_uniform2f(ftr->program[ftr->current_program], uniform_name(u), v2(v));
+    ftr->line_height = ftr->glyphs.ascender + ftr->glyphs.descender + 2 * FTR_SDF_SPREAD;
+    ftr->line_low = ftr->glyphs.descender + FTR_SDF_SPREAD;
 }
 
-static void ftr_init_texture_atlas(ft_renderer_t *ftr, FT_Face face)
+static void ftr_init_instances(ft_renderer_t *ftr)
 {
-    ftr->atlas_w = 0;
-    ftr->atlas_h = 0;
-    ftr->atlas_low = 0;
-
-    FT_Error error;
-    FT_Int32 load_flags = FT_LOAD_RENDER | FT_LOAD_TARGET_(FT_RENDER_MODE_SDF);
-    for (int i = 32; i < 128; i++) {
-        if ((error = FT_Load_Char(face, i, load_flags)) != FT_Err_Ok) {
-            debugf("Error loading char %c: %s\n", i, FT_Error_String(error));
-            continue;
-        }
-        FT_GlyphSlot gs = face->glyph;
-        ftr->atlas_w += gs->bitmap.width;
-        if (ftr->atlas_h < gs->bitmap.rows) {
-            ftr->atlas_h = gs->bitmap.rows;
-        }
-        int low = (int) gs->bitmap.rows - gs->bitmap_top;
-        if ((int) ftr->atlas_low < low) {
-            ftr->atlas_low = low;
-        }
-    }
-
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &ftr->atlas);
-    glBindTexture(GL_TEXTURE_2D, ftr->atlas);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenVertexArrays(1, &ftr->vao);
+    glBindVertexArray(ftr->vao);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    stream_init(&ftr->stream, FTR_STREAM_SIZE);
 
-    glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RED, (GLsizei) ftr->atlas_w, (GLsizei) ftr->atlas_h, 0,
-            GL_RED, GL_UNSIGNED_BYTE,
-            NULL // A null pointer is used to tell OpenGL that  the contents of the
-                 // texture will be provided later.
-    );
-
-    int x = 0;
-    for (int i = 32; i < 128; i++) {
-        if ((error = FT_Load_Char(face, i, load_flags)) != FT_Err_Ok) {
-            panic("Error loading char %c: %s\n", i, FT_Error_String(error));
-        }
-        FT_GlyphSlot gs = face->glyph;
-        if ((error = FT_Render_Glyph(gs, FT_RENDER_MODE_NORMAL)) != FT_Err_Ok) {
-            panic("Error rendering glyph: %s\n", FT_Error_String(error));
-        }
-
-        glTexSubImage2D(
-                GL_TEXTURE_2D, 0, x, 0, gs->bitmap.width, gs->bitmap.rows, GL_RED,
-                GL_UNSIGNED_BYTE, gs->bitmap.buffer);
-
-        ft_glyph_metrics_t *gm = ftr->metrics + i;
-        gm->ax = gs->advance.x >> 6;
-        gm->ay = gs->advance.y >> 6;
-        gm->bw = gs->bitmap.width;
-        gm->bh = gs->bitmap.rows;
-        gm->bl = gs->bitmap_left;
-        gm->bt = gs->bitmap_top;
-        gm->tx = (float) x / ftr->atlas_w;
+    glEnableVertexAttribArray(GLYPH_ATTR_POS);
+    glVertexAttribDivisor(GLYPH_ATTR_POS, 1);
+    glEnableVertexAttribArray(GLYPH_ATTR_GLYPH);
+    glVertexAttribDivisor(GLYPH_ATTR_GLYPH, 1);
+    glEnableVertexAttribArray(GLYPH_ATTR_COLOR);
+    glVertexAttribDivisor(GLYPH_ATTR_COLOR, 1);
+}
 
-        x += face->glyph->bitmap.width;
-    }
+// There is no base instance in GL 3.3, so the attributes are pointed at the instances'
+// offset in the stream buffer instead
+static void ftr_bind_instances(ft_renderer_t *ftr, size_t offset)
+{
+    GLsizei stride = sizeof *ftr->instances.data;
+    glVertexAttribPointer(
+            GLYPH_ATTR_POS, 2, GL_FLOAT, GL_FALSE, stride,
+            (GLvoid *) (offset + offsetof(glyph_instance_t, pos)));
+    glVertexAttribIPointer(
+            GLYPH_ATTR_GLYPH, 1, GL_UNSIGNED_INT, stride,
+            (GLvoid *) (offset + offsetof(glyph_instance_t, glyph)));
+    glVertexAttribIPointer(
+            GLYPH_ATTR_COLOR, 1, GL_UNSIGNED_INT, stride,
+            (GLvoid *) (offset + offsetof(glyph_instance_t, color)));
 }
 
 static char const *uniform_name(enum ft_uniform ftu)
 {
     switch (ftu) {
-        case FTU_TIME:
-            return "u_time";
-            break;
-        case FTU_RESOLUTION:
-            return "u_resolution";
-            break;
-        case FTU_CAMERA:
-            return "u_camera";
-            break;
-        case FTU_SCALE:
-            return "u_scale";
+        case FTU_GLYPHS:
+            return "u_glyphs";
             break;
         default:
             panic("Unreachable\n");
     }
 }
 
-static_assert(FTU_COUNT == 4, "The amount of freetype renderer uniforms has changed.");
+static_assert(FTU_COUNT == 1, "The amount of freetype renderer uniforms has changed.");
@@ -0,0 +1,115 @@
+#include "gap_buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib.h"
+
+#define GB_INIT_CAP 64
+#define GB_MIN_GAP  64
+
+static void gb_move_gap(gb_t *gb, size_t index);
+static void gb_grow(gb_t *gb, size_t size);
+
+void gb_free(gb_t *gb)
+{
+    free(gb->data);
+    *gb = (gb_t) { 0 };
+}
+
+size_t gb_length(gb_t const *gb)
+{
+    return gb->capacity - (gb->gap_end - gb->gap_start);
+}
+
+char gb_at(gb_t const *gb, size_t index)
+{
+    assert(index < gb_length(gb));
+    if (index < gb->gap_start) {
+        return gb->data[index];
+    }
+    return gb->data[index + (gb->gap_end - gb->gap_start)];
+}
+
+void gb_insert(gb_t *gb, char const *data, size_t length, size_t index)
+{
+    assert(index <= gb_length(gb));
+    gb_grow(gb, length);
+    gb_move_gap(gb, index);
+    memcpy(gb->data + gb->gap_start, data, length);
+    gb->gap_start += length;
+}
+
+void gb_remove(gb_t *gb, size_t length, size_t index)
+{
+    assert(index + length <= gb_length(gb));
+    gb_move_gap(gb, index);
+    gb->gap_end += length;
+}
+
+strview_t gb_chunk(gb_t const *gb, size_t index)
+{
+    assert(index <= gb_length(gb));
+    if (index < gb->gap_start) {
+        return (strview_t) { gb->data + index, gb->gap_start - index };
+    }
+    size_t raw = index + (gb->gap_end - gb->gap_start);
+    return (strview_t) { gb->data + raw, gb->capacity - raw };
+}
+
+strview_t gb_chunk_rev(gb_t const *gb, size_t index)
+{
+    assert(index <= gb_length(gb));
+    if (index <= gb->gap_start) {
+        return (strview_t) { gb->data, index };
+    }
+    return (strview_t) { gb->data + gb->gap_end, index - gb->gap_start };
+}
+
+void gb_load_file(gb_t *gb, FILE *fp)
+{
+    assert(fseek(fp, 0, SEEK_END) >= 0);
+    long filesize = ftell(fp);
+    assert(filesize >= 0);
+    assert(fseek(fp, 0, SEEK_SET) >= 0);
+
+    gb_move_gap(gb, gb_length(gb));
+    gb_grow(gb, filesize);
+    if (fread(gb->data + gb->gap_start, 1, filesize, fp) != (size_t) filesize) {
+        panic("Could not read %ld bytes", filesize);
+    }
+    gb->gap_start += filesize;
+}
+
+static void gb_move_gap(gb_t *gb, size_t index)
+{
+    size_t gap = gb->gap_end - gb->gap_start;
+    if (index < gb->gap_start) {
+        size_t n = gb->gap_start - index;
+        memmove(gb->data + gb->gap_end - n, gb->data + index, n);
+    } else if (index > gb->gap_start) {
+        size_t n = index - gb->gap_start;
+        memmove(gb->data + gb->gap_start, gb->data + gb->gap_end, n);
+    }
+    gb->gap_start = index;
+    gb->gap_end = index + gap;
+}
+
+static void gb_grow(gb_t *gb, size_t size)
+{
+    size_t gap = gb->gap_end - gb->gap_start;
+    if (gap >= size) {
+        return;
+    }
+    size_t length = gb_length(gb);
+    size_t cap = max(gb->capacity, (size_t) GB_INIT_CAP);
+    while (cap < length + size + GB_MIN_GAP) {
+        cap *= 2;
+    }
+    size_t tail = gb->capacity - gb->gap_end;
+    gb->data = realloc(gb->data, cap);
+    memmove(gb->data + cap - tail, gb->data + gb->gap_end, tail);
+    gb->gap_end = cap - tail;
+    gb->capacity = cap;
+}
@@ -0,0 +1,807 @@
+#include "glyph_cache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib.h"
+
+#define GC_RENDER_MODE FT_RENDER_MODE_SDF
+#define GC_LOAD_FLAGS  (FT_LOAD_RENDER | FT_LOAD_TARGET_(GC_RENDER_MODE))
+
+#define GC_ATLAS_WIDTH      2048
+#define GC_ATLAS_INIT_H     256
+#define GC_ATLAS_MAX_H      4096
+#define GC_PADDING          1 // Keeps linear filtering from sampling the neighbours
+#define GC_INIT_GLYPHS      128
+#define GC_TABLE_INIT_CAP   64
+#define GC_GLYPH_TABLE_SIZE (8 * sizeof(float)) // Two RGBA32F texels
+
+// A rasterized glyph on its way into the atlas
+typedef struct {
+    uint32_t codepoint;
+    ft_glyph_metrics_t gm;
+    unsigned char const *bitmap; // bw x bh, NULL for glyphs without pixels
+    int pitch;
+    bool fallback; // The font has no glyph for the codepoint
+} gc_raster_t;
+
+#define GC_CACHE_MAGIC   0x4744454d // "MEDG"
+#define GC_CACHE_VERSION 1
+
+// Everything that must match for a cache file to be reused, followed by the sizes of
+// the arrays that come after it: the font path padded to 8 bytes, the metrics, the
+// codepoints, the map entries, the shelves and finally the atlas pixels
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t font_size;
+    int64_t font_mtime_sec;
+    int64_t font_mtime_nsec;
+    uint32_t pixel_size;
+    uint32_t render_mode;
+    uint32_t path_length;
+
+    int32_t ascender;
+    int32_t descender;
+    int32_t atlas_w;
+    int32_t atlas_h;
+    uint32_t glyph_count;
+    uint32_t entry_count;
+    uint32_t shelf_count;
+} gc_cache_header_t;
+
+static uint32_t gc_find(glyph_cache_t const *gc, uint32_t codepoint);
+static void gc_map(glyph_cache_t *gc, uint32_t codepoint, uint32_t glyph);
+static bool gc_add(glyph_cache_t *gc, uint32_t codepoint, uint32_t *glyph);
+static FT_Face gc_face(glyph_cache_t *gc);
+static FT_Face gc_worker_face(glyph_cache_t *gc, size_t worker);
+static char *gc_cache_path(glyph_cache_t const *gc);
+static bool gc_cache_header(glyph_cache_t const *gc, gc_cache_header_t *header);
+static bool gc_load(glyph_cache_t *gc);
+static bool gc_pack(glyph_cache_t *gc, GLsizei w, GLsizei h, GLsizei *x, GLsizei *y);
+static bool gc_grow(glyph_cache_t *gc);
+static void gc_upload_glyph_table(glyph_cache_t *gc);
+static void gc_upload_glyphs(glyph_cache_t *gc, uint32_t first, size_t count);
+
+void gc_free(glyph_cache_t *gc)
+{
+    da_free(&gc->metrics);
+    da_free(&gc->codepoints);
+    da_free(&gc->shelves);
+    da_free(&gc->requests);
+    free(gc->table);
+    free(gc->pixels);
+    glDeleteTextures(1, &gc->atlas);
+    glDeleteTextures(1, &gc->glyph_texture);
+    glDeleteBuffers(1, &gc->glyph_buffer);
+    free(gc->cache_path);
+    if (gc->face != NULL) {
+        FT_Done_Face(gc->face);
+    }
+    if (gc->library != NULL) {
+        FT_Done_FreeType(gc->library);
+    }
+    for (size_t i = 0; gc->pool != NULL && i + 1 < pool_workers(gc->pool); i++) {
+        if (gc->workers[i].face != NULL) {
+            FT_Done_Face(gc->workers[i].face);
+            FT_Done_FreeType(gc->workers[i].library);
+        }
+    }
+    free(gc->workers);
+    *gc = (glyph_cache_t) { 0 };
+}
+
+void gc_init(glyph_cache_t *gc, char const *font_path, FT_UInt pixel_size, pool_t *pool)
+{
+    static pool_t serial = { 0 };
+    *gc = (glyph_cache_t) { 0 };
+    gc->font_path = font_path;
+    gc->pixel_size = pixel_size;
+    gc->pool = pool != NULL ? pool : &serial;
+    gc->workers = calloc(pool_workers(gc->pool) - 1, sizeof *gc->workers);
+
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    gc->atlas_w = min(GC_ATLAS_WIDTH, max_size);
+    gc->atlas_h = min(GC_ATLAS_INIT_H, max_size);
+    gc->atlas_max_h = min(GC_ATLAS_MAX_H, max_size);
+
+    gc->cache_path = gc_cache_path(gc);
+    gc->loaded = gc_load(gc);
+    if (!gc->loaded) {
+        FT_Face face = gc_face(gc);
+        gc->ascender = (face->size->metrics.ascender + 63) >> 6;
+        gc->descender = (-face->size->metrics.descender + 63) >> 6;
+        gc->pixels = calloc((size_t) gc->atlas_w * gc->atlas_h, 1);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, &gc->atlas);
+    glBindTexture(GL_TEXTURE_2D, gc->atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glTexImage2D(
+            GL_TEXTURE_2D, 0, GL_RED, gc->atlas_w, gc->atlas_h, 0, GL_RED,
+            GL_UNSIGNED_BYTE, gc->pixels);
+
+    gc->glyph_capacity = GC_INIT_GLYPHS;
+    glGenBuffers(1, &gc->glyph_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, gc->glyph_buffer);
+    glBufferData(
+            GL_TEXTURE_BUFFER, gc->glyph_capacity * GC_GLYPH_TABLE_SIZE, NULL,
+            GL_DYNAMIC_DRAW);
+
+    glGenTextures(1, &gc->glyph_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, gc->glyph_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, gc->glyph_buffer);
+
+    if (gc->loaded) {
+        gc->generation = 1;
+        gc_upload_glyph_table(gc);
+    } else {
+        gc_clear(gc);
+        // Nearly all of it is about to be drawn anyway, so it is rasterized in one batch
+        for (uint32_t c = 32; c < 127; c++) {
+            gc_request(gc, c);
+        }
+        gc_prefetch(gc);
+    }
+}
+
+bool gc_glyph(glyph_cache_t *gc, uint32_t codepoint, uint32_t *glyph)
+{
+    uint32_t found = gc_find(gc, codepoint);
+    if (found != 0) {
+        *glyph = found - 1;
+        return true;
+    }
+    if (!gc_add(gc, codepoint, glyph)) {
+        return false;
+    }
+    gc_map(gc, codepoint, *glyph);
+    return true;
+}
+
+static void gc_clear_maps(glyph_cache_t *gc)
+{
+    gc->metrics.length = 0;
+    gc->codepoints.length = 0;
+    gc->shelves.length = 0;
+    memset(gc->direct, 0, sizeof gc->direct);
+    if (gc->table != NULL) {
+        memset(gc->table, 0, gc->table_capacity * sizeof *gc->table);
+    }
+    gc->table_length = 0;
+}
+
+void gc_clear(glyph_cache_t *gc)
+{
+    gc_clear_maps(gc);
+    gc->generation++;
+
+    // Padding around new glyphs is never written, so stale pixels have to go
+    memset(gc->pixels, 0, (size_t) gc->atlas_w * gc->atlas_h);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gc->atlas);
+    glTexSubImage2D(
+            GL_TEXTURE_2D, 0, 0, 0, gc->atlas_w, gc->atlas_h, GL_RED, GL_UNSIGNED_BYTE,
+            gc->pixels);
+
+    uint32_t glyph;
+    if (!gc_add(gc, '?', &glyph)) {
+        panic("Could not fit the fallback glyph in the atlas");
+    }
+    assert(glyph == GC_FALLBACK);
+    gc_map(gc, '?', glyph);
+}
+
+void gc_bind(glyph_cache_t const *gc)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gc->atlas);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, gc->glyph_texture);
+}
+
+static size_t gc_hash(uint32_t codepoint, size_t capacity)
+{
+    return (codepoint * 2654435761u) & (capacity - 1);
+}
+
+static uint32_t gc_find(glyph_cache_t const *gc, uint32_t codepoint)
+{
+    if (codepoint < GC_DIRECT_SIZE) {
+        return gc->direct[codepoint];
+    }
+    if (gc->table_length == 0) {
+        return 0;
+    }
+    size_t i = gc_hash(codepoint, gc->table_capacity);
+    while (gc->table[i].glyph != 0) {
+        if (gc->table[i].codepoint == codepoint) {
+            return gc->table[i].glyph;
+        }
+        i = (i + 1) & (gc->table_capacity - 1);
+    }
+    return 0;
+}
+
+static void gc_table_put(gc_entry_t *table, size_t capacity, gc_entry_t entry)
+{
+    size_t i = gc_hash(entry.codepoint, capacity);
+    while (table[i].glyph != 0) {
+        i = (i + 1) & (capacity - 1);
+    }
+    table[i] = entry;
+}
+
+static void gc_map(glyph_cache_t *gc, uint32_t codepoint, uint32_t glyph)
+{
+    if (codepoint < GC_DIRECT_SIZE) {
+        gc->direct[codepoint] = glyph + 1;
+        return;
+    }
+
+    // Keep the load factor at or below one half
+    if (2 * (gc->table_length + 1) > gc->table_capacity) {
+        size_t capacity = max(2 * gc->table_capacity, (size_t) GC_TABLE_INIT_CAP);
+        gc_entry_t *table = calloc(capacity, sizeof *table);
+        for (size_t i = 0; i < gc->table_capacity; i++) {
+            if (gc->table[i].glyph != 0) {
+                gc_table_put(table, capacity, gc->table[i]);
+            }
+        }
+        free(gc->table);
+        gc->table = table;
+        gc->table_capacity = capacity;
+    }
+    gc_table_put(
+            gc->table, gc->table_capacity,
+            (gc_entry_t) { .codepoint = codepoint, .glyph = glyph + 1 });
+    gc->table_length++;
+}
+
+// Fill in the glyph's metrics and point at its bitmap, which lives in the face's glyph slot
+// until the face loads another glyph. `required` is set for the fallback glyph itself.
+static void
+gc_rasterize(FT_Face face, uint32_t codepoint, bool required, gc_raster_t *raster)
+{
+    *raster = (gc_raster_t) { .codepoint = codepoint };
+
+    // Control characters take no space, as they did when only ASCII was rasterized
+    if (codepoint < 32) {
+        return;
+    }
+
+    FT_UInt index = FT_Get_Char_Index(face, codepoint);
+    if (index == 0 && !required) {
+        raster->fallback = true;
+        return;
+    }
+    FT_Error error;
+    if ((error = FT_Load_Glyph(face, index, GC_LOAD_FLAGS)) != FT_Err_Ok) {
+        if (required) {
+            panic("Error loading the fallback glyph: %s", FT_Error_String(error));
+        }
+        debugf("Error loading char U+%04X: %s\n", codepoint, FT_Error_String(error));
+        raster->fallback = true;
+        return;
+    }
+
+    FT_GlyphSlot gs = face->glyph;
+    ft_glyph_metrics_t *gm = &raster->gm;
+    gm->ax = gs->advance.x >> 6;
+    gm->ay = gs->advance.y >> 6;
+    gm->bw = gs->bitmap.width;
+    gm->bh = gs->bitmap.rows;
+    gm->bl = gs->bitmap_left;
+    gm->bt = gs->bitmap_top;
+    raster->bitmap = gs->bitmap.buffer;
+    raster->pitch = gs->bitmap.pitch;
+}
+
+// Pack the glyph into the atlas mirror and append it to the glyph table. The new rect and
+// table entry are only uploaded when `upload` is set. Returns false when the atlas is full.
+static bool
+gc_place(glyph_cache_t *gc, gc_raster_t const *raster, bool upload, uint32_t *glyph)
+{
+    if (raster->fallback) {
+        *glyph = GC_FALLBACK;
+        return true;
+    }
+
+    ft_glyph_metrics_t gm = raster->gm;
+    if (gm.bw > 0 && gm.bh > 0) {
+        GLsizei w = gm.bw, h = gm.bh, x, y;
+        if (w + GC_PADDING > gc->atlas_w || h + GC_PADDING > gc->atlas_max_h) {
+            debugf("Glyph for U+%04X does not fit in the atlas\n", raster->codepoint);
+            *glyph = GC_FALLBACK;
+            return true;
+        }
+        if (!gc_pack(gc, w + GC_PADDING, h + GC_PADDING, &x, &y)) {
+            return false;
+        }
+        for (GLsizei row = 0; row < h; row++) {
+            memcpy(gc->pixels + (size_t) (y + row) * gc->atlas_w + x,
+                   raster->bitmap + row * raster->pitch, w);
+        }
+
+        if (upload) {
+            // Only the new rectangle is uploaded, straight out of the mirror
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gc->atlas);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, gc->atlas_w);
+            glTexSubImage2D(
+                    GL_TEXTURE_2D, 0, x, y, w, h, GL_RED, GL_UNSIGNED_BYTE,
+                    gc->pixels + (size_t) y * gc->atlas_w + x);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        }
+
+        gm.tx = x;
+        gm.ty = y;
+    }
+
+    *glyph = gc->metrics.length;
+    da_push(&gc->metrics, &gm);
+    da_push(&gc->codepoints, &raster->codepoint);
+    if (upload) {
+        gc_upload_glyphs(gc, *glyph, 1);
+    }
+    gc->dirty = true;
+    return true;
+}
+
+static bool gc_add(glyph_cache_t *gc, uint32_t codepoint, uint32_t *glyph)
+{
+    gc_raster_t raster;
+    gc_rasterize(gc_face(gc), codepoint, gc->metrics.length == GC_FALLBACK, &raster);
+    return gc_place(gc, &raster, true, glyph);
+}
+
+typedef struct {
+    glyph_cache_t *gc;
+    uint32_t const *codepoints;
+    gc_raster_t *rasters;
+} gc_batch_t;
+
+// Runs on the pool; every worker has a face of its own, as faces can't be shared between
+// threads. The bitmap is copied out before the worker's face loads its next glyph.
+static void gc_rasterize_task(void *ctx, size_t worker, size_t index)
+{
+    gc_batch_t *batch = ctx;
+    gc_raster_t *raster = &batch->rasters[index];
+    gc_rasterize(gc_worker_face(batch->gc, worker), batch->codepoints[index], false, raster);
+    if (raster->bitmap != NULL) {
+        size_t w = raster->gm.bw, h = raster->gm.bh;
+        unsigned char *bitmap = malloc(w * h);
+        for (size_t row = 0; row < h; row++) {
+            memcpy(bitmap + row * w, raster->bitmap + row * raster->pitch, w);
+        }
+        raster->bitmap = bitmap;
+        raster->pitch = w;
+    }
+}
+
+static int gc_compare_codepoints(void const *a, void const *b)
+{
+    uint32_t x = *(uint32_t const *) a, y = *(uint32_t const *) b;
+    return (x > y) - (x < y);
+}
+
+static double gc_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void gc_request(glyph_cache_t *gc, uint32_t codepoint)
+{
+    if (gc_find(gc, codepoint) == 0) {
+        da_push(&gc->requests, &codepoint);
+    }
+}
+
+void gc_prefetch(glyph_cache_t *gc)
+{
+    if (gc->requests.length == 0) {
+        return;
+    }
+    double start = gc_now();
+
+    uint32_t *codepoints = gc->requests.data;
+    qsort(codepoints, gc->requests.length, sizeof *codepoints, gc_compare_codepoints);
+    size_t count = 0;
+    for (size_t i = 0; i < gc->requests.length; i++) {
+        if (count == 0 || codepoints[count - 1] != codepoints[i]) {
+            codepoints[count++] = codepoints[i];
+        }
+    }
+
+    gc_raster_t *rasters = calloc(count, sizeof *rasters);
+    gc_batch_t batch = { .gc = gc, .codepoints = codepoints, .rasters = rasters };
+    pool_run(gc->pool, count, gc_rasterize_task, &batch);
+
+    // Packing touches the shelves and the mirror, so it stays on this thread. Whatever
+    // doesn't fit is left to `gc_glyph`, which gets to evict.
+    size_t first = gc->metrics.length;
+    GLsizei top = gc->atlas_h, bottom = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t glyph;
+        if (!gc_place(gc, &rasters[i], false, &glyph)) {
+            break;
+        }
+        gc_map(gc, codepoints[i], glyph);
+        if (glyph != GC_FALLBACK && rasters[i].bitmap != NULL) {
+            ft_glyph_metrics_t const *gm = gc_metrics(gc, glyph);
+            top = min(top, (GLsizei) gm->ty);
+            bottom = max(bottom, (GLsizei) (gm->ty + gm->bh));
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        free((void *) rasters[i].bitmap);
+    }
+    free(rasters);
+
+    // One upload for the band of rows the new glyphs landed in
+    if (top < bottom) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gc->atlas);
+        glTexSubImage2D(
+                GL_TEXTURE_2D, 0, 0, top, gc->atlas_w, bottom - top, GL_RED,
+                GL_UNSIGNED_BYTE, gc->pixels + (size_t) top * gc->atlas_w);
+    }
+    if (gc->metrics.length > first) {
+        gc_upload_glyphs(gc, first, gc->metrics.length - first);
+    }
+
+    gc->requests.length = 0;
+    gc->prefetch_count += count;
+    gc->prefetch_seconds += gc_now() - start;
+}
+
+// Place the rectangle on the shelf that fits it most tightly, opening a new shelf at the
+// top when none does
+static bool gc_pack(glyph_cache_t *gc, GLsizei w, GLsizei h, GLsizei *x, GLsizei *y)
+{
+    gc_shelf_t *best = NULL;
+    for (size_t i = 0; i < gc->shelves.length; i++) {
+        gc_shelf_t *shelf = &gc->shelves.data[i];
+        if (shelf->height >= h && shelf->x + w <= gc->atlas_w &&
+            (best == NULL || shelf->height < best->height)) {
+            best = shelf;
+        }
+    }
+
+    if (best == NULL) {
+        GLsizei top = 0;
+        if (gc->shelves.length > 0) {
+            gc_shelf_t const *last = &gc->shelves.data[gc->shelves.length - 1];
+            top = last->y + last->height;
+        }
+        while (top + h > gc->atlas_h) {
+            if (!gc_grow(gc)) {
+                return false;
+            }
+        }
+        gc_shelf_t shelf = { .y = top, .height = h, .x = 0 };
+        da_push(&gc->shelves, &shelf);
+        best = &gc->shelves.data[gc->shelves.length - 1];
+    }
+
+    *x = best->x;
+    *y = best->y;
+    best->x += w;
+    return true;
+}
+
+// The glyph table holds pixel coordinates, so glyphs already packed stay valid
+static bool gc_grow(glyph_cache_t *gc)
+{
+    if (gc->atlas_h >= gc->atlas_max_h) {
+        return false;
+    }
+    GLsizei atlas_h = min(2 * gc->atlas_h, gc->atlas_max_h);
+    size_t old_size = (size_t) gc->atlas_w * gc->atlas_h;
+    size_t new_size = (size_t) gc->atlas_w * atlas_h;
+    gc->pixels = realloc(gc->pixels, new_size);
+    memset(gc->pixels + old_size, 0, new_size - old_size);
+    gc->atlas_h = atlas_h;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gc->atlas);
+    glTexImage2D(
+            GL_TEXTURE_2D, 0, GL_RED, gc->atlas_w, gc->atlas_h, 0, GL_RED,
+            GL_UNSIGNED_BYTE, gc->pixels);
+    return true;
+}
+
+static void gc_glyph_texels(ft_glyph_metrics_t const *gm, float texels[8])
+{
+    float const t[8] = { gm->bl, gm->bt, gm->bw, gm->bh, gm->tx, gm->ty, gm->bw, gm->bh };
+    memcpy(texels, t, sizeof t);
+}
+
+// Respecify the storage to fit every glyph and upload the whole table at once
+static void gc_upload_glyph_table(glyph_cache_t *gc)
+{
+    while (gc->metrics.length > gc->glyph_capacity) {
+        gc->glyph_capacity *= 2;
+    }
+    float(*table)[8] = malloc(gc->metrics.length * sizeof *table);
+    for (size_t i = 0; i < gc->metrics.length; i++) {
+        gc_glyph_texels(gc_metrics(gc, i), table[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, gc->glyph_buffer);
+    glBufferData(
+            GL_TEXTURE_BUFFER, gc->glyph_capacity * GC_GLYPH_TABLE_SIZE, NULL,
+            GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, gc->metrics.length * sizeof *table, table);
+    free(table);
+}
+
+static void gc_upload_glyphs(glyph_cache_t *gc, uint32_t first, size_t count)
+{
+    if (first + count > gc->glyph_capacity) {
+        gc_upload_glyph_table(gc);
+        return;
+    }
+    float(*texels)[8] = malloc(count * sizeof *texels);
+    for (size_t i = 0; i < count; i++) {
+        gc_glyph_texels(gc_metrics(gc, first + i), texels[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, gc->glyph_buffer);
+    glBufferSubData(
+            GL_TEXTURE_BUFFER, first * GC_GLYPH_TABLE_SIZE, count * sizeof *texels, texels);
+    free(texels);
+}
+
+static void gc_open_face(glyph_cache_t const *gc, FT_Library *library, FT_Face *face)
+{
+    FT_Error error = FT_Init_FreeType(library);
+    if (FT_Err_Ok != error) {
+        panic("Could not initialize the FreeType library: %s", FT_Error_String(error));
+    }
+
+    error = FT_New_Face(*library, gc->font_path, 0, face);
+    if (error == FT_Err_Cannot_Open_Resource) {
+        panic("Could not open font filename: %s", gc->font_path);
+    } else if (error != FT_Err_Ok) {
+        panic("Could not create face: %d - %s", error, FT_Error_String(error));
+    }
+
+    error = FT_Set_Pixel_Sizes(*face, 0, gc->pixel_size);
+    if (FT_Err_Ok != error) {
+        panic("Could not set pixel sizes: %s", FT_Error_String(error));
+    }
+}
+
+static FT_Face gc_face(glyph_cache_t *gc)
+{
+    if (gc->face == NULL) {
+        gc_open_face(gc, &gc->library, &gc->face);
+    }
+    return gc->face;
+}
+
+// Each worker only ever touches its own slot
+static FT_Face gc_worker_face(glyph_cache_t *gc, size_t worker)
+{
+    if (worker == 0) {
+        return gc_face(gc);
+    }
+    gc_worker_t *w = &gc->workers[worker - 1];
+    if (w->face == NULL) {
+        gc_open_face(gc, &w->library, &w->face);
+    }
+    return w->face;
+}
+
+// Disk cache
+
+// $XDG_CACHE_HOME/med/glyphs-<key hash>.cache, falling back to ~/.cache
+static char *gc_cache_path(glyph_cache_t const *gc)
+{
+    char const *base = getenv("XDG_CACHE_HOME");
+    char const *suffix = "";
+    if (base == NULL || *base == '\0') {
+        base = getenv("HOME");
+        suffix = "/.cache";
+    }
+    if (base == NULL || *base == '\0') {
+        return NULL;
+    }
+
+    // FNV-1a over everything in the key but the font's stat, which is checked on load
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char const *c = gc->font_path; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char) *c) * 0x100000001b3;
+    }
+    hash = (hash ^ gc->pixel_size) * 0x100000001b3;
+
+    size_t size = strlen(base) + strlen(suffix) + 64;
+    char *path = malloc(size);
+    snprintf(path, size, "%s%s", base, suffix);
+    mkdir(path, 0755);
+    strcat(path, "/med");
+    mkdir(path, 0755);
+    snprintf(path + strlen(path), size - strlen(path), "/glyphs-%016llx.cache",
+             (unsigned long long) hash);
+    return path;
+}
+
+static bool gc_cache_header(glyph_cache_t const *gc, gc_cache_header_t *header)
+{
+    struct stat st;
+    if (stat(gc->font_path, &st) != 0) {
+        return false;
+    }
+    *header = (gc_cache_header_t) {
+        .magic = GC_CACHE_MAGIC,
+        .version = GC_CACHE_VERSION,
+        .font_size = st.st_size,
+        .font_mtime_sec = st.st_mtim.tv_sec,
+        .font_mtime_nsec = st.st_mtim.tv_nsec,
+        .pixel_size = gc->pixel_size,
+        .render_mode = GC_RENDER_MODE,
+        .path_length = strlen(gc->font_path),
+    };
+    return true;
+}
+
+static size_t gc_align(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+static bool gc_load(glyph_cache_t *gc)
+{
+    gc_cache_header_t key;
+    if (gc->cache_path == NULL || !gc_cache_header(gc, &key)) {
+        return false;
+    }
+    int fd = open(gc->cache_path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof key) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    char const *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    bool ok = false;
+    gc_cache_header_t const *header = (gc_cache_header_t const *) data;
+    size_t offset = sizeof *header;
+    if (memcmp(header, &key, offsetof(gc_cache_header_t, ascender)) != 0 ||
+        header->atlas_w != gc->atlas_w || header->atlas_h > gc->atlas_max_h ||
+        header->atlas_h <= 0) {
+        defer(ok = false);
+    }
+    size_t path_size = gc_align(header->path_length);
+    size_t metrics_size = header->glyph_count * sizeof(ft_glyph_metrics_t);
+    size_t codepoints_size = header->glyph_count * sizeof(uint32_t);
+    size_t entries_size = header->entry_count * sizeof(gc_entry_t);
+    size_t shelves_size = header->shelf_count * sizeof(gc_shelf_t);
+    size_t pixels_size = (size_t) header->atlas_w * header->atlas_h;
+    if (header->glyph_count == 0 ||
+        size != offset + path_size + metrics_size + codepoints_size + entries_size +
+                        shelves_size + pixels_size ||
+        memcmp(data + offset, gc->font_path, header->path_length) != 0) {
+        defer(ok = false);
+    }
+    offset += path_size;
+
+    gc->ascender = header->ascender;
+    gc->descender = header->descender;
+    da_push_n(&gc->metrics, data + offset, header->glyph_count);
+    offset += metrics_size;
+    da_push_n(&gc->codepoints, data + offset, header->glyph_count);
+    offset += codepoints_size;
+    gc_entry_t const *entries = (gc_entry_t const *) (data + offset);
+    for (size_t i = 0; i < header->entry_count; i++) {
+        if (entries[i].glyph == 0 || entries[i].glyph > header->glyph_count) {
+            gc_clear_maps(gc);
+            defer(ok = false);
+        }
+        gc_map(gc, entries[i].codepoint, entries[i].glyph - 1);
+    }
+    offset += entries_size;
+    da_push_n(&gc->shelves, data + offset, header->shelf_count);
+    offset += shelves_size;
+
+    gc->atlas_h = header->atlas_h;
+    gc->pixels = malloc(pixels_size);
+    memcpy(gc->pixels, data + offset, pixels_size);
+    ok = true;
+
+defer:
+    munmap((void *) data, size);
+    return ok;
+}
+
+bool gc_save(glyph_cache_t const *gc)
+{
+    gc_cache_header_t header;
+    if (!gc->dirty || gc->cache_path == NULL || !gc_cache_header(gc, &header)) {
+        return true;
+    }
+    header.ascender = gc->ascender;
+    header.descender = gc->descender;
+    header.atlas_w = gc->atlas_w;
+    header.atlas_h = gc->atlas_h;
+    header.glyph_count = gc->metrics.length;
+    header.shelf_count = gc->shelves.length;
+
+    da(gc_entry_t) entries = { 0 };
+    for (uint32_t c = 0; c < GC_DIRECT_SIZE; c++) {
+        if (gc->direct[c] != 0) {
+            gc_entry_t entry = { .codepoint = c, .glyph = gc->direct[c] };
+            da_push(&entries, &entry);
+        }
+    }
+    for (size_t i = 0; i < gc->table_capacity; i++) {
+        if (gc->table[i].glyph != 0) {
+            da_push(&entries, &gc->table[i]);
+        }
+    }
+    header.entry_count = entries.length;
+
+    // Written next to the cache and renamed over it, so a reader never sees half of it
+    size_t path_size = strlen(gc->cache_path) + 5;
+    char *tmp_path = malloc(path_size);
+    snprintf(tmp_path, path_size, "%s.tmp", gc->cache_path);
+
+    bool ok = false;
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        debugf("Could not write glyph cache %s: %s\n", tmp_path, strerror(errno));
+        defer(ok = false);
+    }
+    char const padding[8] = { 0 };
+    ok = fwrite(&header, sizeof header, 1, fp) == 1 &&
+         fwrite(gc->font_path, 1, header.path_length, fp) == header.path_length &&
+         fwrite(padding, 1, gc_align(header.path_length) - header.path_length, fp) ==
+                 gc_align(header.path_length) - header.path_length &&
+         fwrite(gc->metrics.data, sizeof *gc->metrics.data, gc->metrics.length, fp) ==
+                 gc->metrics.length &&
+         fwrite(gc->codepoints.data, sizeof *gc->codepoints.data, gc->codepoints.length,
+                fp) == gc->codepoints.length &&
+         fwrite(entries.data, sizeof *entries.data, entries.length, fp) ==
+                 entries.length &&
+         fwrite(gc->shelves.data, sizeof *gc->shelves.data, gc->shelves.length, fp) ==
+                 gc->shelves.length &&
+         fwrite(gc->pixels, 1, (size_t) gc->atlas_w * gc->atlas_h, fp) ==
+                 (size_t) gc->atlas_w * gc->atlas_h;
+    ok = fclose(fp) == 0 && ok;
+    if (ok && rename(tmp_path, gc->cache_path) != 0) {
+        debugf("Could not write glyph cache %s: %s\n", gc->cache_path, strerror(errno));
+        ok = false;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+    }
+
+defer:
+    free(tmp_path);
+    da_free(&entries);
+    return ok;
+}
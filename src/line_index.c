@@ -0,0 +1,318 @@
+#include "line_index.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib.h"
+
+#define NODE(i) (li->nodes.data[i])
+
+static uint32_t li_random(line_index_t *li);
+static uint32_t li_node(line_index_t *li, size_t length, uint32_t priority);
+static void li_release(line_index_t *li, uint32_t t);
+static void li_update(line_index_t *li, uint32_t t);
+static void li_split(line_index_t *li, uint32_t t, size_t k, uint32_t *l, uint32_t *r);
+static uint32_t li_merge(line_index_t *li, uint32_t l, uint32_t r);
+static uint32_t li_build(
+        line_index_t *li, size_t const *lengths, size_t count, size_t depth,
+        size_t max_depth);
+
+void li_free(line_index_t *li)
+{
+    da_free(&li->nodes);
+    da_free(&li->unused);
+    *li = (line_index_t) { 0 };
+}
+
+size_t li_line_count(line_index_t const *li)
+{
+    if (li->root == 0) {
+        return 1;
+    }
+    return NODE(li->root).count;
+}
+
+size_t li_line_start(line_index_t const *li, size_t row)
+{
+    size_t offset = 0;
+    uint32_t t = li->root;
+    while (t != 0) {
+        line_node_t const *n = &NODE(t);
+        line_node_t const *l = &NODE(n->left);
+        if (row < l->count) {
+            t = n->left;
+        } else if (row == l->count) {
+            return offset + l->sum;
+        } else {
+            row -= l->count + 1;
+            offset += l->sum + n->length;
+            t = n->right;
+        }
+    }
+    return offset;
+}
+
+size_t li_line_length(line_index_t const *li, size_t row)
+{
+    uint32_t t = li->root;
+    while (t != 0) {
+        line_node_t const *n = &NODE(t);
+        line_node_t const *l = &NODE(n->left);
+        if (row < l->count) {
+            t = n->left;
+        } else if (row == l->count) {
+            return n->length;
+        } else {
+            row -= l->count + 1;
+            t = n->right;
+        }
+    }
+    return 0;
+}
+
+size_t li_row(line_index_t const *li, size_t offset)
+{
+    if (li->root == 0) {
+        return 0;
+    }
+    if (offset >= NODE(li->root).sum) {
+        return NODE(li->root).count - 1;
+    }
+    size_t row = 0;
+    uint32_t t = li->root;
+    while (t != 0) {
+        line_node_t const *n = &NODE(t);
+        line_node_t const *l = &NODE(n->left);
+        if (offset < l->sum) {
+            t = n->left;
+            continue;
+        }
+        offset -= l->sum;
+        if (offset < n->length) {
+            return row + l->count;
+        }
+        offset -= n->length;
+        row += l->count + 1;
+        t = n->right;
+    }
+    panic("Unreachable");
+}
+
+static void li_set_width_in(line_index_t *li, uint32_t t, size_t row, float width)
+{
+    size_t left_count = NODE(NODE(t).left).count;
+    if (row < left_count) {
+        li_set_width_in(li, NODE(t).left, row, width);
+    } else if (row == left_count) {
+        NODE(t).width = width;
+    } else {
+        li_set_width_in(li, NODE(t).right, row - left_count - 1, width);
+    }
+    li_update(li, t);
+}
+
+void li_set_width(line_index_t *li, size_t row, float width)
+{
+    if (li->root != 0 && row < NODE(li->root).count) {
+        li_set_width_in(li, li->root, row, width);
+    }
+}
+
+// Only subtrees that stick out of the range are descended into, so at most two paths
+static float
+li_max_width_in(line_index_t const *li, uint32_t t, size_t first, size_t last)
+{
+    line_node_t const *n = &NODE(t);
+    if (t == 0 || first > last || first >= n->count) {
+        return 0;
+    }
+    if (first == 0 && last + 1 >= n->count) {
+        return n->max_width;
+    }
+    size_t left_count = NODE(n->left).count;
+    float width = 0;
+    if (first < left_count) {
+        width = li_max_width_in(li, n->left, first, min(last, left_count - 1));
+    }
+    if (first <= left_count && left_count <= last) {
+        width = max(width, n->width);
+    }
+    if (last > left_count) {
+        size_t right_first = first > left_count ? first - left_count - 1 : 0;
+        width = max(width,
+                    li_max_width_in(li, n->right, right_first, last - left_count - 1));
+    }
+    return width;
+}
+
+float li_max_width(line_index_t const *li, size_t first, size_t last)
+{
+    return li_max_width_in(li, li->root, first, last);
+}
+
+static size_t li_unmeasured_in(line_index_t const *li, uint32_t t, size_t row)
+{
+    line_node_t const *n = &NODE(t);
+    if (t == 0 || n->unmeasured == 0 || row >= n->count) {
+        return n->count;
+    }
+    size_t left_count = NODE(n->left).count;
+    if (row < left_count) {
+        size_t found = li_unmeasured_in(li, n->left, row);
+        if (found < left_count) {
+            return found;
+        }
+    }
+    if (row <= left_count && n->width < 0) {
+        return left_count;
+    }
+    size_t right_row = row > left_count ? row - left_count - 1 : 0;
+    return left_count + 1 + li_unmeasured_in(li, n->right, right_row);
+}
+
+size_t li_unmeasured(line_index_t const *li, size_t row)
+{
+    if (li->root == 0) {
+        return 1; // The empty line needs no measuring
+    }
+    return li_unmeasured_in(li, li->root, row);
+}
+
+void li_replace(
+        line_index_t *li, size_t first, size_t last, size_t const *lengths, size_t count)
+{
+    assert(first <= last);
+    if (li->nodes.length == 0) {
+        line_node_t nil = { 0 };
+        da_push(&li->nodes, &nil);
+        li->seed = 0x9e3779b9;
+    }
+
+    uint32_t head, middle, tail;
+    li_split(li, li->root, first, &head, &middle);
+    li_split(li, middle, last - first + 1, &middle, &tail);
+    li_release(li, middle);
+
+    // Priorities are assigned per level so that the built subtree is balanced and still
+    // satisfies the heap property
+    size_t max_depth = 0;
+    while (((size_t) 1 << max_depth) <= count) {
+        max_depth++;
+    }
+    middle = li_build(li, lengths, count, 0, max_depth);
+    li->root = li_merge(li, li_merge(li, head, middle), tail);
+}
+
+static uint32_t li_random(line_index_t *li)
+{
+    uint32_t x = li->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return li->seed = x;
+}
+
+static uint32_t li_node(line_index_t *li, size_t length, uint32_t priority)
+{
+    line_node_t node = {
+        .priority = priority,
+        .length = length,
+        .sum = length,
+        .count = 1,
+        .width = -1,
+        .unmeasured = 1,
+    };
+    if (li->unused.length > 0) {
+        uint32_t t = li->unused.data[--li->unused.length];
+        NODE(t) = node;
+        return t;
+    }
+    da_push(&li->nodes, &node);
+    return li->nodes.length - 1;
+}
+
+static void li_release(line_index_t *li, uint32_t t)
+{
+    if (t == 0) {
+        return;
+    }
+    li_release(li, NODE(t).left);
+    li_release(li, NODE(t).right);
+    da_push(&li->unused, &t);
+}
+
+static void li_update(line_index_t *li, uint32_t t)
+{
+    line_node_t *n = &NODE(t);
+    n->sum = NODE(n->left).sum + n->length + NODE(n->right).sum;
+    n->count = NODE(n->left).count + 1 + NODE(n->right).count;
+    n->max_width = max(max(NODE(n->left).max_width, n->width), NODE(n->right).max_width);
+    n->unmeasured =
+            NODE(n->left).unmeasured + (n->width < 0) + NODE(n->right).unmeasured;
+}
+
+// Split the first `k` lines of `t` into `l` and the rest into `r`
+static void li_split(line_index_t *li, uint32_t t, size_t k, uint32_t *l, uint32_t *r)
+{
+    if (t == 0) {
+        *l = *r = 0;
+        return;
+    }
+    size_t left_count = NODE(NODE(t).left).count;
+    if (k <= left_count) {
+        uint32_t left;
+        li_split(li, NODE(t).left, k, l, &left);
+        NODE(t).left = left;
+        *r = t;
+    } else {
+        uint32_t right;
+        li_split(li, NODE(t).right, k - left_count - 1, &right, r);
+        NODE(t).right = right;
+        *l = t;
+    }
+    li_update(li, t);
+}
+
+static uint32_t li_merge(line_index_t *li, uint32_t l, uint32_t r)
+{
+    if (l == 0 || r == 0) {
+        return l + r;
+    }
+    if (NODE(l).priority > NODE(r).priority) {
+        uint32_t right = li_merge(li, NODE(l).right, r);
+        NODE(l).right = right;
+        li_update(li, l);
+        return l;
+    } else {
+        uint32_t left = li_merge(li, l, NODE(r).left);
+        NODE(r).left = left;
+        li_update(li, r);
+        return r;
+    }
+}
+
+static uint32_t li_build(
+        line_index_t *li, size_t const *lengths, size_t count, size_t depth,
+        size_t max_depth)
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t band = UINT32_MAX / (max_depth + 1);
+    uint32_t priority = (max_depth - depth) * band + li_random(li) % band;
+    if (max_depth == 1) {
+        priority = li_random(li);
+    }
+
+    size_t mid = count / 2;
+    uint32_t t = li_node(li, lengths[mid], priority);
+    uint32_t left = li_build(li, lengths, mid, depth + 1, max_depth);
+    uint32_t right =
+            li_build(li, lengths + mid + 1, count - mid - 1, depth + 1, max_depth);
+    NODE(t).left = left;
+    NODE(t).right = right;
+    li_update(li, t);
+    return t;
+}
@@ -0,0 +1,184 @@
+#include "loader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include "lib.h"
+
+#define LD_FIRST_CHUNK (64 * 1024)       // About a screenful, so it shows up right away
+#define LD_MAX_CHUNK   (4 * 1024 * 1024) // Chunks double in size up to this
+
+// Page faults on these may block for as long as a read does, so they are read instead
+static bool ld_remote(int fd)
+{
+    struct statfs fs;
+    if (fstatfs(fd, &fs) != 0) {
+        return false;
+    }
+    switch ((unsigned long) fs.f_type) {
+        case NFS_SUPER_MAGIC:
+        case SMB_SUPER_MAGIC:
+        case SMB2_SUPER_MAGIC:
+        case CIFS_SUPER_MAGIC:
+        case FUSE_SUPER_MAGIC:
+        case V9FS_MAGIC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void ld_done(loader_t *ld, int error)
+{
+    pthread_mutex_lock(&ld->mutex);
+    ld->error = error;
+    ld->done = true;
+    pthread_mutex_unlock(&ld->mutex);
+}
+
+static void *ld_thread(void *arg)
+{
+    loader_t *ld = arg;
+    FILE *fp = fopen(ld->path, "r");
+    if (fp == NULL) {
+        ld_done(ld, errno);
+        return NULL;
+    }
+
+    struct stat filestat;
+    int fd = fileno(fp);
+    bool regular = fstat(fd, &filestat) == 0 && S_ISREG(filestat.st_mode);
+    pthread_mutex_lock(&ld->mutex);
+    ld->regular = regular;
+    ld->stat = filestat;
+    pthread_mutex_unlock(&ld->mutex);
+    fv_t view = { 0 };
+    if (regular && !ld_remote(fd) && fv_load_file(&view, fp)) {
+        pthread_mutex_lock(&ld->mutex);
+        ld->view = view;
+        ld->size = ld->read = view.length;
+        ld->done = true;
+        pthread_mutex_unlock(&ld->mutex);
+        fclose(fp);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ld->mutex);
+    ld->size = regular ? filestat.st_size : 0;
+    pthread_mutex_unlock(&ld->mutex);
+
+    size_t chunk_size = LD_FIRST_CHUNK;
+    char *chunk = malloc(LD_MAX_CHUNK);
+    int error = 0;
+    while (!atomic_load(&ld->cancel)) {
+        ssize_t n = read(fd, chunk, chunk_size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            error = n < 0 ? errno : 0;
+            break;
+        }
+        pthread_mutex_lock(&ld->mutex);
+        str_push(&ld->pending, chunk, n);
+        ld->read += n;
+        pthread_mutex_unlock(&ld->mutex);
+        chunk_size = min(2 * chunk_size, LD_MAX_CHUNK);
+    }
+    free(chunk);
+    fclose(fp);
+    ld_done(ld, error);
+    return NULL;
+}
+
+void ld_free(loader_t *ld)
+{
+    if (ld->running) {
+        atomic_store(&ld->cancel, true);
+        pthread_join(ld->thread, NULL);
+        pthread_mutex_destroy(&ld->mutex);
+    }
+    fv_free(&ld->view);
+    str_free(&ld->pending);
+    free(ld->path);
+    *ld = (loader_t) { 0 };
+}
+
+void ld_start(loader_t *ld, char const *path)
+{
+    ld_free(ld);
+    ld->path = strdup(path);
+    pthread_mutex_init(&ld->mutex, NULL);
+    if (pthread_create(&ld->thread, NULL, ld_thread, ld) != 0) {
+        panic("Could not start the loader thread: %s", strerror(errno));
+    }
+    ld->running = true;
+}
+
+// Move what was read so far into `b`. Returns whether the thread is done.
+static bool ld_drain(loader_t *ld, buffer_t *b)
+{
+    pthread_mutex_lock(&ld->mutex);
+    str_t pending = ld->pending;
+    ld->pending = (str_t) { 0 };
+    fv_t view = ld->view;
+    ld->view = (fv_t) { 0 };
+    bool done = ld->done;
+    pthread_mutex_unlock(&ld->mutex);
+
+    if (view.length > 0) {
+        buffer_load_view(b, &view);
+    }
+    if (pending.length > 0) {
+        buffer_append_loaded(b, pending.data, pending.length);
+    }
+    str_free(&pending);
+    return done;
+}
+
+static void ld_join(loader_t *ld)
+{
+    pthread_join(ld->thread, NULL);
+    pthread_mutex_destroy(&ld->mutex);
+    ld->running = false;
+}
+
+bool ld_poll(loader_t *ld, buffer_t *b)
+{
+    if (!ld->running) {
+        return false;
+    }
+    if (!ld_drain(ld, b)) {
+        return true;
+    }
+    ld_join(ld);
+    return false;
+}
+
+void ld_finish(loader_t *ld, buffer_t *b)
+{
+    if (!ld->running) {
+        return;
+    }
+    pthread_join(ld->thread, NULL);
+    ld_drain(ld, b);
+    pthread_mutex_destroy(&ld->mutex);
+    ld->running = false;
+}
+
+float ld_progress(loader_t *ld)
+{
+    if (!ld->running) {
+        return 1;
+    }
+    pthread_mutex_lock(&ld->mutex);
+    float progress = ld->size > 0 ? (float) ld->read / ld->size : -1;
+    pthread_mutex_unlock(&ld->mutex);
+    return progress;
+}
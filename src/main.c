@@ -1,21 +1,27 @@
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
-#include <freetype2/ft2build.h>
-#include FT_FREETYPE_H
-
 #include "cursor_renderer.h"
 #include "editor.h"
 #include "freetype_renderer.h"
 #include "la.h"
 #include "lib.h"
+#include "pool.h"
 #include "program_object.h"
+#include "search.h"
+#include "stream.h"
+#include "utf8.h"
 
 #define SCREEN_WIDTH  800
 #define SCREEN_HEIGHT 600
@@ -23,6 +29,17 @@
 #define MIN_SCALE     0.225
 #define PIXEL_SIZE    128
 
+#define VISIBLE_MARGIN 2         // Rows rendered above and below the window
+#define INDEX_STEP     (4 << 20) // Bytes of a loaded file indexed for lines per frame
+#define ADVANCE_STEP   64        // Bytes between cached positions on the cursor's line
+#define SEARCH_MARGIN  64        // Rows searched above and below the visible ones
+
+// Waiting for events instead of polling
+#define IDLE_FPS               20   // Redraw rate for time-driven effects only
+#define CURSOR_BLINK_THRESHOLD 0.5  // Keep in sync with shaders/cursor.frag
+#define CAMERA_EPSILON         0.1  // Camera is considered still below this speed
+#define SCALE_EPSILON          1e-4 // Scale is considered still below this speed
+
 #define FONT_FREE_FILENAME "fonts/VictorMono-Regular.ttf"
 // #define FONT_FREE_FILENAME "fonts/Qdbettercomicsans-jEEeG.ttf"
 // #define FONT_FREE_FILENAME "fonts/ttf - Mx (mixed outline+bitmap)/Mx437_Mindset.ttf"
@@ -46,13 +63,85 @@ static editor_t editor = { 0 };
 static ft_renderer_t ftr = { 0 };
 static cursor_renderer_t cr = { 0 };
 static renderer_t r = { 0 };
+static ftr_layer_t text_layer = { 0 };
 static GLFWwindow *window = NULL;
+static pool_t pool = { 0 };
+static pool_t search_pool = { 0 }; // Finds every match of the I-Search query
+static size_t thread_count = 0;    // 0 picks the amount of online CPUs
+
+// Matches of the I-Search query in [start, end), which covers the visible rows. They are
+// highlighted until every match of the buffer is found in the background, which takes
+// a while for large buffers. Scrolling by less than SEARCH_MARGIN rows reuses them.
+static struct {
+    size_t version;
+    str_t query;
+    size_t start;
+    size_t end;
+    search_matches_t matches;
+} search_cache = { .version = SIZE_MAX };
+
+typedef struct {
+    size_t index;
+    float x;
+} line_mark_t;
+
+// Pen positions along one line, one every ADVANCE_STEP bytes. Positions on the line are
+// measured from the closest mark instead of from the line start, and marks are only
+// added as far as positions were asked for. Any edit drops them.
+static struct {
+    size_t version;
+    size_t start; // Of the line
+    da(line_mark_t) marks;
+} line_marks = { .version = SIZE_MAX };
+
+static bool wait_events = false;
+static bool print_stats = false;
+static struct {
+    size_t frames;
+    double busy;    // Seconds spent producing frames, excluding time waiting for events
+    double started; // glfwGetTime() when the main loop started, i.e. the startup time
+} stats = { 0 };
+
+static void print_frame_stats(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+                 usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    double wall = glfwGetTime() - stats.started;
+    printf("[STATS] startup: %.1f ms, glyph cache %s, FreeType %s\n",
+           1000.0 * stats.started, ftr.glyphs.loaded ? "loaded" : "rebuilt",
+           ftr.glyphs.face == NULL ? "never loaded" : "loaded");
+    printf("[STATS] rasterized %zu glyphs in batches in %.1f ms on %zu threads\n",
+           ftr.glyphs.prefetch_count, 1000.0 * ftr.glyphs.prefetch_seconds,
+           pool_workers(&pool));
+    printf("[STATS] %s: %zu frames, %.3f ms per frame, %.1f%% CPU over %.1f s\n",
+           wait_events ? "wait" : "poll", stats.frames,
+           1000.0 * stats.busy / max(stats.frames, (size_t) 1), 100.0 * cpu / wall, wall);
+}
+
+// Per-view uniform state shared by every program through the `Frame` block. The overlay
+// (minibuffer) is drawn at a fixed scale with the camera at the origin.
+static GLuint scene_frame;
+static GLuint overlay_frame;
 
 static void terminate(void)
 {
+    if (print_stats) {
+        print_frame_stats();
+    }
     editor_free(&editor);
+    ftr_layer_free(&text_layer);
+    str_free(&search_cache.query);
+    da_free(&search_cache.matches);
+    da_free(&line_marks.marks);
+    gc_save(&ftr.glyphs);
     ftr_free(&ftr);
+    pool_free(&pool);
+    pool_free(&search_pool);
     cr_free(&cr);
+    program_object_frame_free(scene_frame);
+    program_object_frame_free(overlay_frame);
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -63,38 +152,201 @@ float cursor_time_moved = 0;
 float g_scale = MAX_SCALE;
 GLuint basic_program;
 
-void render_scene(float dt)
+// Damage tracking: what the cached text geometry and measurements were computed from.
+// Camera, scale and time only feed uniforms, so while the buffer and the visible rows are
+// unchanged nothing has to be regenerated.
+static struct {
+    size_t version;
+    size_t first;
+    size_t last;
+    size_t glyphs; // Glyph cache generation the layer's glyph indices belong to
+} text_layer_key = { .version = SIZE_MAX };
+
+// Chunk of [start, end) that ends on a codepoint boundary. A sequence split between two
+// chunks of the buffer is copied into `scratch` instead.
+static strview_t
+buffer_text_chunk(buffer_t const *b, size_t start, size_t end, char *scratch)
+{
+    strview_t chunk = buffer_chunk(b, start);
+    if (chunk.length >= end - start) {
+        chunk.length = end - start;
+        return chunk;
+    }
+    size_t tail = utf8_incomplete_tail(chunk.data, chunk.length);
+    if (tail < chunk.length) {
+        chunk.length -= tail;
+        return chunk;
+    }
+    size_t n = min(utf8_sequence_length(chunk.data[0]), end - start);
+    for (size_t i = 0; i < n; i++) {
+        scratch[i] = buffer_at(b, start + i);
+    }
+    return (strview_t) { .data = scratch, .length = n };
+}
+
+static void prefetch_buffer(buffer_t const *b, size_t start, size_t end)
+{
+    char scratch[UTF8_MAX_LENGTH];
+    while (start < end) {
+        strview_t chunk = buffer_text_chunk(b, start, end, scratch);
+        ftr_request(&ftr, chunk.data, chunk.length);
+        start += chunk.length;
+    }
+    ftr_prefetch(&ftr);
+}
+
+static v2f_t
+render_buffer(buffer_t const *b, size_t start, size_t end, v2f_t pos, v4f_t color)
+{
+    char scratch[UTF8_MAX_LENGTH];
+    while (start < end) {
+        strview_t chunk = buffer_text_chunk(b, start, end, scratch);
+        pos = ftr_render_text(&ftr, chunk.data, chunk.length, pos, color);
+        start += chunk.length;
+    }
+    return pos;
+}
+
+static v2f_t buffer_cursor_pos(buffer_t const *b, size_t start, size_t end, v2f_t pos)
+{
+    char scratch[UTF8_MAX_LENGTH];
+    while (start < end) {
+        strview_t chunk = buffer_text_chunk(b, start, end, scratch);
+        pos = ftr_cursor_pos(&ftr, chunk.data, chunk.length, pos);
+        start += chunk.length;
+    }
+    return pos;
+}
+
+// Widest line among rows [first, last]. Lines are measured once, their widths stay in
+// the line index until they are edited.
+static float widest_line(size_t first, size_t last)
+{
+    buffer_t *b = &editor.file->buffer;
+    size_t row = first;
+    while ((row = buffer_unmeasured_line(b, row)) <= last) {
+        size_t start = buffer_line_start(b, row);
+        size_t end = start + buffer_line_length(b, row);
+        if (end > start && buffer_at(b, end - 1) == '\n') {
+            end--;
+        }
+        buffer_set_line_width(b, row, buffer_cursor_pos(b, start, end, v2fs(0)).x);
+        row++;
+    }
+    return buffer_max_line_width(b, first, last);
+}
+
+// Position of `index` in the text buffer, in O(log n) for the row plus at most
+// ADVANCE_STEP bytes measured once the marks of its line reach it
+static v2f_t text_pos(size_t index)
+{
+    buffer_t const *b = &editor.file->buffer;
+    size_t row = buffer_row(b, index);
+    size_t start = buffer_line_start(b, row);
+    if (line_marks.version != b->version || line_marks.start != start) {
+        line_marks.version = b->version;
+        line_marks.start = start;
+        line_marks.marks.length = 0;
+        line_mark_t mark = { .index = start };
+        da_push(&line_marks.marks, &mark);
+    }
+
+    // Mark k is the first codepoint boundary at or after `start + k * ADVANCE_STEP`
+    line_mark_t mark = line_marks.marks.data[line_marks.marks.length - 1];
+    size_t next;
+    while ((next = start + line_marks.marks.length * ADVANCE_STEP) <= index) {
+        while (next < index && utf8_is_continuation(buffer_at(b, next))) {
+            next++;
+        }
+        mark.x = buffer_cursor_pos(b, mark.index, next, v2f(mark.x, 0)).x;
+        mark.index = next;
+        da_push(&line_marks.marks, &mark);
+    }
+    size_t k = min((index - start) / ADVANCE_STEP, line_marks.marks.length - 1);
+    if (line_marks.marks.data[k].index > index) {
+        k--;
+    }
+    mark = line_marks.marks.data[k];
+    return buffer_cursor_pos(
+            b, mark.index, index, v2f(mark.x, -(float) row * ftr.line_height));
+}
+
+// Queue highlights of [start, end) of the text buffer, one rect per line
+static void render_highlight(size_t start, size_t end, v4f_t color)
+{
+    buffer_t const *b = &editor.file->buffer;
+    size_t row = buffer_row(b, start);
+    size_t line_start = buffer_line_start(b, row);
+    v2f_t pos = v2f(0, -(float) row * ftr.line_height);
+    pos = buffer_cursor_pos(b, line_start, start, pos);
+    while (start < end) {
+        size_t line_end = min(buffer_find_char(b, '\n', start), end);
+        v2f_t end_pos = buffer_cursor_pos(b, start, line_end, pos);
+        end_pos.x += ftr_char_width(&ftr, ' ') * (line_end != end);
+        renderer_solid_rect(
+                &r, v2f(pos.x, pos.y - ftr.line_low),
+                v2f(end_pos.x - pos.x, ftr.line_height), color);
+        start = line_end + 1;
+        pos = v2f(0, pos.y - ftr.line_height);
+    }
+}
+
+// Rows of the text buffer that intersect the window, plus a small margin so that lines
+// scrolling in are already there
+static void visible_rows(size_t *first, size_t *last)
+{
+    float half_height = resolution.y / (2 * g_scale);
+    float top = -(camera_pos.y + half_height) / ftr.line_height;
+    float bottom = -(camera_pos.y - half_height) / ftr.line_height;
+    size_t line_count = buffer_line_count(&editor.file->buffer);
+
+    *first = max((int) floorf(top) - VISIBLE_MARGIN, 0);
+    *last = min((size_t) max((int) ceilf(bottom) + VISIBLE_MARGIN, 0), line_count - 1);
+}
+
+// Returns whether the camera or the scale is still easing towards its target, or the
+// text buffer is still being loaded, indexed or saved
+bool render_scene(float dt)
 {
     float const VEL = 3;
-    dt *= VEL;
+    dt = min(dt * VEL, 1.0); // Frames can be far apart when waiting for events
+    bool animating = false;
+    bool loading = editor_load_poll(&editor);
+    animating |= loading || editor_save_poll(&editor);
+    animating |= editor_isearch_poll(&editor);
+
+    // Lines of loaded files are indexed lazily: the rows that can be on screen must be
+    // exact, the rest of the file is indexed a bit every frame
+    {
+        size_t rows = resolution.y / (ftr.line_height * MIN_SCALE) + VISIBLE_MARGIN;
+        buffer_index_to(&editor.file->buffer, editor.file->cursor);
+        buffer_index_rows(&editor.file->buffer, editor_get_cursor_row(&editor) + rows);
+        animating |= !buffer_index_step(&editor.file->buffer, INDEX_STEP);
+    }
 
     float max_line_width = 0;
     {
-        size_t line_size = ftr.atlas_h * g_scale;
+        size_t line_size = ftr.line_height * g_scale;
         size_t line_count = resolution.y / line_size;
         size_t line_start =
                 max((int) editor_get_cursor_row(&editor) - (int) (line_count / 2), 0);
-        size_t line_end =
-                min(editor_get_cursor_row(&editor) + line_count / 2,
-                    editor_get_line_count(&editor));
-        size_t start = editor_nth_char_index(&editor, '\n', line_start);
-        size_t end = editor_nth_char_index(&editor, '\n', line_end + 1);
-        /////////////////////////////////////////////////////////////////////////////////
-        max_line_width = ftr_get_max_line_width(
-                &ftr, editor.text_buffer.data + start, end - start);
+        size_t line_end = min(editor_get_cursor_row(&editor) + line_count / 2,
+                              editor_get_line_count(&editor));
+        max_line_width = widest_line(line_start, line_end);
         float g_scale_target =
                 max(MIN_SCALE, min(MAX_SCALE, 0.6 * resolution.x / max_line_width));
         float g_scale_vel = g_scale_target - g_scale;
         g_scale += g_scale_vel * dt;
+        animating |= fabsf(g_scale_vel) > SCALE_EPSILON;
     }
 
     v2f_t cur_pos = { 0 }, cur_size = { 0 };
     {
-        cur_pos = ftr_cursor_pos(&ftr, editor.text_buffer.data, editor.text_cursor);
-        char c = editor_get_char(&editor);
+        cur_pos = text_pos(editor.file->cursor);
+        uint32_t c = editor_get_codepoint(&editor);
         float cur_width = ftr_char_width(&ftr, (c != '\0' && c != '\n') ? c : ' ');
-        cur_size = v2f(cur_width, ftr.atlas_h);
-        cur_pos.y -= ftr.atlas_low;
+        cur_size = v2f(cur_width, ftr.line_height);
+        cur_pos.y -= ftr.line_low;
     }
 
     {
@@ -115,88 +367,227 @@ void render_scene(float dt)
         v2f_t camera_target = v2f(camera_target_x, cur_pos.y + cur_size.y / 2.0);
         v2f_t camera_vel = v2f_sub(camera_target, camera_pos);
         camera_pos = v2f_add(camera_pos, v2f_mulf(camera_vel, dt));
+        animating |= fabsf(camera_vel.x) > CAMERA_EPSILON ||
+                     fabsf(camera_vel.y) > CAMERA_EPSILON;
     }
 
     float const time = glfwGetTime();
+    frame_uniforms_t frame = {
+        .camera = camera_pos,
+        .resolution = resolution,
+        .scale = g_scale,
+        .time = time,
+    };
+    program_object_frame_update(scene_frame, &frame);
+    program_object_frame_bind(scene_frame);
     {
-        cr_set(&cr, CU_TIME, time);
-        cr_set(&cr, CU_SCALE, g_scale);
-        cr_set(&cr, CU_CAMERA, camera_pos);
-        cr_set(&cr, CU_RESOLUTION, resolution);
         cr_set(&cr, CU_TIME_MOVED, cursor_time_moved);
         cr_draw(&cr, cur_pos, cur_size, v4fs(1.0));
         ///////////////////////////////////////////////////////////////////////////////////
         ftr_use(&ftr, FTP_RAINBOW);
-        ftr_set(&ftr, FTU_TIME, time);
-        ftr_set(&ftr, FTU_SCALE, g_scale);
-        ftr_set(&ftr, FTU_CAMERA, camera_pos);
-        ftr_set(&ftr, FTU_RESOLUTION, resolution);
 
-        ftr_render_text(
-                &ftr, editor.text_buffer.data, editor.text_buffer.length, v2fs(0),
-                v4fs(1));
-        ftr_draw(&ftr);
+        size_t first, last;
+        visible_rows(&first, &last);
+        if (text_layer_key.version != editor.file->buffer.version ||
+            text_layer_key.first != first || text_layer_key.last != last ||
+            text_layer_key.glyphs != ftr_generation(&ftr)) {
+            text_layer_key.version = editor.file->buffer.version;
+            text_layer_key.first = first;
+            text_layer_key.last = last;
+
+            size_t start = buffer_line_start(&editor.file->buffer, first);
+            size_t end = buffer_line_start(&editor.file->buffer, last) +
+                         buffer_line_length(&editor.file->buffer, last);
+            prefetch_buffer(&editor.file->buffer, start, end);
+            render_buffer(
+                    &editor.file->buffer, start, end,
+                    v2f(0, -(float) first * ftr.line_height), v4fs(1));
+            ftr_layer_store(&ftr, &text_layer);
+            // Read after rendering: glyphs evicted while queueing the layer were
+            // re-resolved, so the layer is valid for the current generation
+            text_layer_key.glyphs = ftr_generation(&ftr);
+        }
+        ftr_layer_draw(&ftr, &text_layer);
     }
 
-    // Render minibuffer
+    // Render minibuffer, or the load progress in its place
     if (editor.mini) {
-        ftr_set(&ftr, FTU_SCALE, (float) MIN_SCALE);
-        ftr_set(&ftr, FTU_CAMERA, v2fs(0));
+        frame.camera = v2fs(0);
+        frame.scale = MIN_SCALE;
+        program_object_frame_update(overlay_frame, &frame);
+        program_object_frame_bind(overlay_frame);
         v2f_t pos = ftr_render_text(
                 &ftr, editor.miniprompt, strlen(editor.miniprompt),
                 v2f_add(v2f_divf(v2f_neg(resolution), 2 * MIN_SCALE), v2fs(100)),
                 v4fs(1));
-        ftr_render_text(
-                &ftr, editor.minibuffer.data, editor.minibuffer.length,
+        pos = render_buffer(
+                &editor.minibuffer, 0, buffer_length(&editor.minibuffer),
                 v2f(pos.x + 100, pos.y), v4fs(1));
+        if (editor_isearching(&editor) && editor.search_query.length > 0) {
+            // Which match the cursor is on, once all of them are found
+            search_matches_t const *matches = editor_isearch_matches(&editor);
+            char count[64] = "...";
+            if (matches != NULL && editor.search_found) {
+                snprintf(count, sizeof count, "%zu/%zu",
+                         search_lower_bound(matches, editor.search_match) + 1,
+                         matches->length);
+            } else if (matches != NULL) {
+                snprintf(count, sizeof count, "0/%zu", matches->length);
+            }
+            ftr_render_text(
+                    &ftr, count, strlen(count), v2f(pos.x + 100, pos.y),
+                    v4f(0.6, 0.6, 0.6, 1));
+        }
+        ftr_draw(&ftr);
+        program_object_frame_bind(scene_frame);
+    } else if (editor.file->loader.running) {
+        char status[32] = "Loading...";
+        float progress = ld_progress(&editor.file->loader);
+        if (progress >= 0) {
+            snprintf(status, sizeof status, "Loading... %d%%", (int) (100 * progress));
+        }
+        frame.camera = v2fs(0);
+        frame.scale = MIN_SCALE;
+        program_object_frame_update(overlay_frame, &frame);
+        program_object_frame_bind(overlay_frame);
+        ftr_render_text(
+                &ftr, status, strlen(status),
+                v2f_add(v2f_divf(v2f_neg(resolution), 2 * MIN_SCALE), v2fs(100)),
+                v4fs(1));
         ftr_draw(&ftr);
+        program_object_frame_bind(scene_frame);
     }
 
-    // Render selection
-    if (editor.mark_set) {
-        program_object_use(basic_program);
-        program_object_uniform1f(basic_program, "u_scale", g_scale);
-        program_object_uniform2f(basic_program, "u_camera", v2(camera_pos));
-        program_object_uniform2f(basic_program, "u_resolution", v2(resolution));
-        size_t mark_begin = editor.mark;
-        size_t mark_end = editor.text_cursor;
-        if (mark_begin > mark_end) {
-            swap(mark_begin, mark_end);
+    // Render search matches and the selection. Both are clipped to the visible rows and
+    // drawn together in a single batch.
+    {
+        buffer_t const *b = &editor.file->buffer;
+        size_t first, last;
+        visible_rows(&first, &last);
+        size_t start = buffer_line_start(b, first);
+        size_t end = buffer_line_start(b, last) + buffer_line_length(b, last);
+
+        str_t const *query = &editor.search_query;
+        search_matches_t const *matches = editor_isearch_matches(&editor);
+        if (editor_isearching(&editor) && matches == NULL &&
+            (search_cache.version != b->version ||
+             search_cache.query.length != query->length ||
+             (query->length > 0 &&
+              memcmp(search_cache.query.data, query->data, query->length) != 0) ||
+             start < search_cache.start || end > search_cache.end)) {
+            size_t from = first - min(first, SEARCH_MARGIN);
+            size_t to = min(last + SEARCH_MARGIN, buffer_line_count(b) - 1);
+            search_cache.version = b->version;
+            search_cache.query.length = 0;
+            str_push(&search_cache.query, query->data, query->length);
+            search_cache.start = buffer_line_start(b, from);
+            search_cache.end = buffer_line_start(b, to) + buffer_line_length(b, to);
+            // Matches that run into the first row start before it
+            search_range(
+                    &pool, b, query->data, query->length,
+                    search_cache.start - min(search_cache.start, query->length),
+                    search_cache.end, &search_cache.matches);
+        }
+
+        if (editor_isearching(&editor)) {
+            if (matches == NULL) {
+                matches = &search_cache.matches;
+            }
+            // Overlapping matches are merged so that no byte is highlighted twice
+            size_t length = query->length;
+            size_t i = search_lower_bound(matches, start - min(start, length));
+            for (; i < matches->length && matches->data[i] < end; i++) {
+                size_t from = max(matches->data[i], start);
+                size_t to = min(matches->data[i] + length, end);
+                while (i + 1 < matches->length && matches->data[i + 1] < to) {
+                    to = min(matches->data[++i] + length, end);
+                }
+                if (from < to) {
+                    render_highlight(from, to, v4f(1, 0.8, 0, 0.3));
+                }
+            }
         }
 
-        while (mark_begin < mark_end) {
-            size_t end_line = str_find_char(&editor.text_buffer, '\n', mark_begin);
-            if (end_line > mark_end) {
-                end_line = mark_end;
+        if (editor.mark_set) {
+            size_t mark_begin = editor.mark;
+            size_t mark_end = editor.file->cursor;
+            if (mark_begin > mark_end) {
+                swap(mark_begin, mark_end);
             }
-            v2f_t start_pos = ftr_cursor_pos(&ftr, editor.text_buffer.data, mark_begin);
-            v2f_t end_pos = ftr_cursor_pos(&ftr, editor.text_buffer.data, end_line);
-            end_pos.x += ftr_char_width(&ftr, ' ') * (end_line != mark_end);
-            assert(start_pos.y == end_pos.y);
-            start_pos.y -= ftr.atlas_low;
-            renderer_solid_rect(
-                    &r, start_pos, v2f(end_pos.x - start_pos.x, ftr.atlas_h),
-                    v4f(1, 1, 1, 0.3));
+            mark_begin = max(mark_begin, start);
+            mark_end = min(mark_end, end);
+            if (mark_begin < mark_end) {
+                render_highlight(mark_begin, mark_end, v4f(1, 1, 1, 0.3));
+            }
+        }
+
+        if (r.vertices.length > 0) {
+            program_object_use(basic_program);
             renderer_draw(&r);
-            mark_begin = end_line + 1;
         }
     }
+
+    return animating;
 }
+// Nothing moves on its own once the camera and the scale settle, except for the
+// time-driven shader effects. Those are sampled at IDLE_FPS, plus an exact wakeup for
+// the moment the cursor starts blinking.
+static double idle_timeout(double now)
+{
+    double timeout = 1.0 / IDLE_FPS;
+    double blink = cursor_time_moved + CURSOR_BLINK_THRESHOLD - now;
+    if (blink > 0 && blink < timeout) {
+        timeout = blink;
+    }
+    return timeout;
+}
+
 static void initialize_glfw(GLFWwindow **window);
 static void initialize_glew(void);
-static void initialize_freetype(FT_Face *face);
 
 int main(int argc, char const *argv[])
 {
-    if (argc > 1) {
-        editor_load_file(&editor, argv[1]);
+    editor_new(&editor);
+
+    da(char const *) filenames = { 0 };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--piece-table") == 0) {
+            editor.buffer_kind = BUFFER_PIECE;
+        } else if (strcmp(argv[i], "--gap-buffer") == 0) {
+            editor.buffer_kind = BUFFER_GAP;
+        } else if (strcmp(argv[i], "--stream=ring") == 0) {
+            stream_mode = STREAM_RING;
+        } else if (strcmp(argv[i], "--stream=orphan") == 0) {
+            stream_mode = STREAM_ORPHAN;
+        } else if (strcmp(argv[i], "--stream=subdata") == 0) {
+            stream_mode = STREAM_SUBDATA;
+        } else if (strcmp(argv[i], "--wait-events") == 0) {
+            wait_events = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = true;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            thread_count = strtoul(argv[i] + 10, NULL, 10);
+        } else if (strncmp(argv[i], "--undo-budget=", 14) == 0) {
+            // In MiB
+            editor.undo_budget = strtoul(argv[i] + 14, NULL, 10) << 20;
+        } else if (strncmp(argv[i], "--buffer-memory=", 16) == 0) {
+            // In MiB
+            editor.memory = strtoul(argv[i] + 16, NULL, 10) << 20;
+        } else {
+            da_push(&filenames, &argv[i]);
+        }
+    }
+    // The unnamed buffer was made before the budget was known
+    editor.file->undo.budget = editor.undo_budget;
+    // The last file is shown
+    for (size_t i = 0; i < filenames.length; i++) {
+        editor_load_file(&editor, filenames.data[i]);
     }
+    da_free(&filenames);
 
-    FT_Face face = { 0 };
     atexit(terminate);
     initialize_glfw(&window);
     initialize_glew();
-    initialize_freetype(&face);
 
     renderer_init(&r);
     if (!program_object_link(
@@ -205,30 +596,44 @@ int main(int argc, char const *argv[])
         return 1;
     }
 
-    if (!cr_init(&cr) || !ftr_init(&ftr, face)) {
+    if (thread_count == 0) {
+        thread_count = max(sysconf(_SC_NPROCESSORS_ONLN), 1);
+    }
+    pool_init(&pool, thread_count);
+    pool_init(&search_pool, thread_count);
+    editor.search_pool = &search_pool;
+    if (!cr_init(&cr) || !ftr_init(&ftr, FONT_FREE_FILENAME, PIXEL_SIZE, &pool)) {
         return 1;
     }
+    program_object_frame_init(&scene_frame);
+    program_object_frame_init(&overlay_frame);
     ftr_use(&ftr, FTP_RAINBOW);
 
-    editor_new(&editor);
-
-    size_t cur_last_pos = editor.text_cursor;
+    size_t cur_last_pos = editor.file->cursor;
     float dt, now, last_frame = 0.0;
+    stats.started = glfwGetTime();
     while (!glfwWindowShouldClose(window)) {
         now = glfwGetTime();
         dt = now - last_frame;
         last_frame = now;
 
-        if (editor.text_cursor != cur_last_pos) {
-            cur_last_pos = editor.text_cursor;
+        if (editor.file->cursor != cur_last_pos) {
+            cur_last_pos = editor.file->cursor;
             cursor_time_moved = now;
         }
 
         glClearColor(0.0, 0.0, 0.0, 1.0);
         glClear(GL_COLOR_BUFFER_BIT);
-        render_scene(dt);
+        bool animating = render_scene(dt);
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        stats.frames++;
+        stats.busy += glfwGetTime() - now;
+
+        if (wait_events && !animating) {
+            glfwWaitEventsTimeout(idle_timeout(glfwGetTime()));
+        } else {
+            glfwPollEvents();
+        }
     }
     return 0;
 }
@@ -267,6 +672,16 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
             case GLFW_KEY_SLASH:
                 editor_isearch(&editor);
                 break;
+            case GLFW_KEY_R:
+                editor_isearch_backward(&editor);
+                break;
+            case GLFW_KEY_MINUS:
+                if (mods & GLFW_MOD_ALT) {
+                    editor_redo(&editor);
+                } else {
+                    editor_undo(&editor);
+                }
+                break;
 
             case GLFW_KEY_P:
                 editor_previous_line(&editor);
@@ -284,6 +699,9 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
             case GLFW_KEY_D:
                 editor_fsnav(&editor);
                 break;
+            case GLFW_KEY_L:
+                editor_list_buffers(&editor);
+                break;
 
             case GLFW_KEY_SPACE:
                 editor_set_mark(&editor);
@@ -316,8 +734,11 @@ static void character_callback(GLFWwindow *window, unsigned int codepoint)
         return;
     }
     //////////////////////////////////////////////////////////////////////
-    assert(32 <= codepoint && codepoint < 127);
-    editor_self_insert(&editor, codepoint);
+    char text[UTF8_MAX_LENGTH];
+    size_t text_size = utf8_encode(codepoint, text);
+    if (text_size > 0) {
+        editor_insert(&editor, text, text_size);
+    }
 }
 
 static void framebuffer_size_callback(GLFWwindow *window, int width, int height)
@@ -377,25 +798,3 @@ static void initialize_glew(void)
         panic("Error: GLEW_ARB_instanced_arrays not supported.");
     }
 }
-
-static void initialize_freetype(FT_Face *face)
-{
-    FT_Library library = { 0 };
-    FT_Error error = FT_Init_FreeType(&library);
-    if (FT_Err_Ok != error) {
-        panic("Could not initialize the FreeType library: %s", FT_Error_String(error));
-    }
-
-    error = FT_New_Face(library, FONT_FREE_FILENAME, 0, face);
-    if (error == FT_Err_Cannot_Open_Resource) {
-        panic("Could not open font filename: %s", FONT_FREE_FILENAME);
-    } else if (error != FT_Err_Ok) {
-        panic("Could not create face: %d - %s", error, FT_Error_String(error));
-    }
-
-    FT_UInt pixel_size = PIXEL_SIZE;
-    error = FT_Set_Pixel_Sizes(*face, 0, pixel_size);
-    if (FT_Err_Ok != error) {
-        panic("Could not set pixel sizes: %s", FT_Error_String(error));
-    }
-}
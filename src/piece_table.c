@@ -0,0 +1,257 @@
+#include "piece_table.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+
+#define PT_BLOCK_SIZE (64 * 1024)
+
+static size_t pt_find(pt_t const *pt, size_t index);
+static size_t pt_split(pt_t *pt, size_t index);
+static void pt_update_starts(pt_t *pt, size_t from);
+static char const *pt_append(pt_t *pt, char const *data, size_t length);
+
+void pt_free(pt_t *pt)
+{
+    if (pt->mapped) {
+        munmap(pt->original, pt->original_length);
+    } else {
+        free(pt->original);
+    }
+    for (size_t i = 0; i < pt->blocks.length; i++) {
+        free(pt->blocks.data[i]);
+    }
+    da_free(&pt->blocks);
+    da_free(&pt->pieces);
+    *pt = (pt_t) { 0 };
+}
+
+size_t pt_length(pt_t const *pt)
+{
+    return pt->length;
+}
+
+char pt_at(pt_t const *pt, size_t index)
+{
+    assert(index < pt->length);
+    return pt_chunk(pt, index).data[0];
+}
+
+void pt_insert(pt_t *pt, char const *data, size_t length, size_t index)
+{
+    assert(index <= pt->length);
+    if (length == 0) {
+        return;
+    }
+    char const *p = pt_append(pt, data, length);
+    size_t k = pt_split(pt, index);
+
+    // Consecutive self-inserts land right after the previous piece in the add block, so
+    // they extend it instead of creating a new piece per keystroke
+    piece_t *prev = k > 0 ? &pt->pieces.data[k - 1] : NULL;
+    bool fresh_block = pt->block_used == length;
+    if (prev != NULL && !fresh_block && prev->data + prev->length == p) {
+        prev->length += length;
+    } else {
+        piece_t piece = { .data = p, .length = length };
+        da_insert_n(&pt->pieces, &piece, 1, k);
+    }
+    pt->length += length;
+    pt_update_starts(pt, k > 0 ? k - 1 : 0);
+}
+
+void pt_insert_spans(pt_t *pt, strview_t const *spans, size_t count, size_t index)
+{
+    assert(index <= pt->length);
+    da(piece_t) pieces = { 0 };
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (spans[i].length > 0) {
+            piece_t piece = { .data = spans[i].data, .length = spans[i].length };
+            da_push(&pieces, &piece);
+            length += spans[i].length;
+        }
+    }
+    if (pieces.length == 0) {
+        return;
+    }
+    size_t k = pt_split(pt, index);
+    pt->length += length;
+    da_insert_n(&pt->pieces, pieces.data, pieces.length, k);
+    da_free(&pieces);
+    pt_update_starts(pt, k > 0 ? k - 1 : 0);
+}
+
+void pt_remove(pt_t *pt, size_t length, size_t index)
+{
+    assert(index + length <= pt->length);
+    if (length == 0) {
+        return;
+    }
+    size_t first = pt_split(pt, index);
+    size_t last = pt_split(pt, index + length);
+    da_remove_n(&pt->pieces, last - first, first);
+    pt->length -= length;
+    pt_update_starts(pt, first);
+}
+
+strview_t pt_chunk(pt_t const *pt, size_t index)
+{
+    assert(index <= pt->length);
+    if (index == pt->length) {
+        return (strview_t) { 0 };
+    }
+    piece_t const *piece = &pt->pieces.data[pt_find(pt, index)];
+    size_t offset = index - piece->start;
+    return (strview_t) { piece->data + offset, piece->length - offset };
+}
+
+strview_t pt_chunk_rev(pt_t const *pt, size_t index)
+{
+    assert(index <= pt->length);
+    if (index == 0) {
+        return (strview_t) { 0 };
+    }
+    piece_t const *piece = &pt->pieces.data[pt_find(pt, index - 1)];
+    return (strview_t) { piece->data, index - piece->start };
+}
+
+// The original file is mapped rather than read, so loading costs the same regardless of
+// the file size. Files that cannot be mapped (pipes, empty files) are read instead.
+void pt_load_file(pt_t *pt, FILE *fp)
+{
+    assert(pt->length == 0 && pt->original == NULL);
+
+    struct stat filestat;
+    int fd = fileno(fp);
+    if (fstat(fd, &filestat) == 0 && S_ISREG(filestat.st_mode) && filestat.st_size > 0) {
+        void *addr = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            pt_load_mapping(pt, addr, filestat.st_size);
+            return;
+        }
+    }
+
+    str_t s = { 0 };
+    str_load_file(&s, fp);
+    pt->original = s.data;
+    pt->original_length = s.length;
+    if (pt->original_length > 0) {
+        piece_t piece = { .data = pt->original, .length = pt->original_length };
+        da_push(&pt->pieces, &piece);
+        pt->length = pt->original_length;
+    }
+}
+
+void pt_load_mapping(pt_t *pt, char *data, size_t length)
+{
+    assert(pt->length == 0 && pt->original == NULL);
+    assert(length > 0);
+    pt->original = data;
+    pt->original_length = length;
+    pt->mapped = true;
+
+    piece_t piece = { .data = data, .length = length };
+    da_push(&pt->pieces, &piece);
+    pt->length = length;
+}
+
+void pt_detach(pt_t *pt, size_t start, size_t length)
+{
+    if (!pt->mapped) {
+        return;
+    }
+    char const *lo = pt->original + start;
+    char const *hi = lo + length;
+    for (size_t i = 0; i < pt->pieces.length; i++) {
+        piece_t piece = pt->pieces.data[i];
+        char const *a = max(piece.data, lo);
+        char const *b = min(piece.data + piece.length, hi);
+        if (a >= b) {
+            continue;
+        }
+        // The piece becomes the part before [a, b), a copy of it, and the part after
+        piece_t parts[3];
+        size_t n = 0;
+        if (piece.data < a) {
+            parts[n++] = (piece_t) { .data = piece.data, .length = a - piece.data };
+        }
+        parts[n++] = (piece_t) { .data = pt_append(pt, a, b - a), .length = b - a };
+        if (b < piece.data + piece.length) {
+            parts[n++] = (piece_t) { .data = b, .length = piece.data + piece.length - b };
+        }
+        da_remove(&pt->pieces, i);
+        da_insert_n(&pt->pieces, parts, n, i);
+        i += n - 1;
+    }
+    pt_update_starts(pt, 0);
+}
+
+// Index of the piece that contains `index`
+static size_t pt_find(pt_t const *pt, size_t index)
+{
+    assert(index < pt->length);
+    size_t lo = 0, hi = pt->pieces.length;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pt->pieces.data[mid].start <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Make `index` a piece boundary and return the index of the piece that starts there
+static size_t pt_split(pt_t *pt, size_t index)
+{
+    if (index == pt->length) {
+        return pt->pieces.length;
+    }
+    size_t k = pt_find(pt, index);
+    piece_t piece = pt->pieces.data[k];
+    size_t offset = index - piece.start;
+    if (offset == 0) {
+        return k;
+    }
+    piece_t right = {
+        .data = piece.data + offset,
+        .length = piece.length - offset,
+        .start = index,
+    };
+    pt->pieces.data[k].length = offset;
+    da_insert_n(&pt->pieces, &right, 1, k + 1);
+    return k + 1;
+}
+
+static void pt_update_starts(pt_t *pt, size_t from)
+{
+    size_t start = 0;
+    if (from > 0) {
+        piece_t const *prev = &pt->pieces.data[from - 1];
+        start = prev->start + prev->length;
+    }
+    for (size_t i = from; i < pt->pieces.length; i++) {
+        pt->pieces.data[i].start = start;
+        start += pt->pieces.data[i].length;
+    }
+}
+
+static char const *pt_append(pt_t *pt, char const *data, size_t length)
+{
+    if (pt->blocks.length == 0 || pt->block_used + length > pt->block_capacity) {
+        char *block = malloc(max(length, (size_t) PT_BLOCK_SIZE));
+        da_push(&pt->blocks, &block);
+        pt->block_used = 0;
+        pt->block_capacity = max(length, (size_t) PT_BLOCK_SIZE);
+    }
+    char *p = pt->blocks.data[pt->blocks.length - 1] + pt->block_used;
+    memcpy(p, data, length);
+    pt->block_used += length;
+    return p;
+}
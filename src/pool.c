@@ -0,0 +1,113 @@
+#include "pool.h"
+
+#include <stdlib.h>
+
+#include "lib.h"
+
+typedef struct {
+    pool_t *pool;
+    size_t worker;
+} pool_thread_t;
+
+static void pool_work(pool_t *pool, size_t worker)
+{
+    size_t index;
+    while ((index = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+        pool->fn(pool->ctx, worker, index);
+    }
+}
+
+static void *pool_thread(void *arg)
+{
+    pool_thread_t thread = *(pool_thread_t *) arg;
+    free(arg);
+    pool_t *pool = thread.pool;
+
+    size_t seen = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (pool->batch == seen && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->batch;
+        pthread_mutex_unlock(&pool->mutex);
+
+        pool_work(pool, thread.worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+void pool_free(pool_t *pool)
+{
+    if (pool->thread_count > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->quit = true;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->mutex);
+        for (size_t i = 0; i < pool->thread_count; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->start);
+        pthread_mutex_destroy(&pool->mutex);
+    }
+    free(pool->threads);
+    *pool = (pool_t) { 0 };
+}
+
+void pool_init(pool_t *pool, size_t workers)
+{
+    *pool = (pool_t) { 0 };
+    if (workers <= 1) {
+        return;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->threads = malloc((workers - 1) * sizeof *pool->threads);
+    for (size_t i = 0; i < workers - 1; i++) {
+        pool_thread_t *thread = malloc(sizeof *thread);
+        *thread = (pool_thread_t) { .pool = pool, .worker = i + 1 };
+        if (pthread_create(&pool->threads[i], NULL, pool_thread, thread) != 0) {
+            panic("Could not create worker thread");
+        }
+        pool->thread_count++;
+    }
+}
+
+void pool_run(pool_t *pool, size_t count, pool_fn fn, void *ctx)
+{
+    if (pool->thread_count == 0 || count <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(ctx, 0, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->thread_count;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
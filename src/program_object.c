@@ -47,19 +47,63 @@ defer:
     return ret;
 }
 
+void program_object_locate(
+        GLuint program, char const *const *uniform_names, size_t uniform_count,
+        GLint *locations)
+{
+    for (size_t i = 0; i < uniform_count; i++) {
+        locations[i] = glGetUniformLocation(program, uniform_names[i]);
+        if (locations[i] == -1) {
+            debugf("Uniform %s is not active in program %u\n", uniform_names[i], program);
+        }
+    }
+}
+
 void program_object_use(GLuint program)
 {
-    glUseProgram(program);
+    static GLuint current = 0;
+    if (program != current) {
+        glUseProgram(program);
+        current = program;
+    }
+}
+
+void program_object_uniform1i(GLint location, int i)
+{
+    glUniform1i(location, i);
+}
+
+void program_object_uniform1f(GLint location, float f)
+{
+    glUniform1f(location, f);
 }
 
-void program_object_uniform1f(GLuint program, char const *uniform_name, float f)
+void program_object_uniform2f(GLint location, float f, float g)
 {
-    glUniform1f(glGetUniformLocation(program, uniform_name), f);
+    glUniform2f(location, f, g);
 }
 
-void program_object_uniform2f(GLuint program, char const *uniform_name, float f, float g)
+void program_object_frame_init(GLuint *ubo)
 {
-    glUniform2f(glGetUniformLocation(program, uniform_name), f, g);
+    glGenBuffers(1, ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, *ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_uniforms_t), NULL, GL_DYNAMIC_DRAW);
+}
+
+void program_object_frame_free(GLuint ubo)
+{
+    glDeleteBuffers(1, &ubo);
+}
+
+void program_object_frame_update(GLuint ubo, frame_uniforms_t const *frame)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof *frame, frame);
+}
+
+void program_object_frame_bind(GLuint ubo)
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, ubo);
 }
 
 static bool shader_compile(
@@ -113,5 +157,10 @@ static bool program_link(GLuint *program, GLuint *shaders, size_t shader_count)
         return false;
     }
 
+    GLuint frame_block = glGetUniformBlockIndex(*program, "Frame");
+    if (frame_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(*program, frame_block, FRAME_BLOCK_BINDING);
+    }
+
     return true;
 }
@@ -1,9 +1,13 @@
 #include "renderer.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "lib.h"
 
+#define RENDERER_STREAM_SIZE (64 * 1024)
+
 enum vertex_attr {
     VERTEX_ATTR_UV = 0,
     VERTEX_ATTR_POS,
@@ -13,19 +17,18 @@ enum vertex_attr {
 void renderer_free(renderer_t *r)
 {
     glDeleteVertexArrays(1, &r->vao);
-    glDeleteBuffers(1, &r->vbo);
+    stream_free(&r->stream);
+    da_free(&r->vertices);
 }
 
 void renderer_init(renderer_t *r)
 {
-    r->vertex_count = 0;
+    r->vertices = (typeof(r->vertices)) { 0 };
 
     glGenVertexArrays(1, &r->vao);
     glBindVertexArray(r->vao);
 
-    glGenBuffers(1, &r->vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof r->vertices, r->vertices, GL_DYNAMIC_DRAW);
+    stream_init(&r->stream, RENDERER_STREAM_SIZE);
 
 #define gl_set_vertex_attribute(attr, buffer, member)                                    \
     do {                                                                                 \
@@ -35,21 +38,20 @@ void renderer_init(renderer_t *r)
                 GL_FALSE, sizeof *buffer, (GLvoid *) offsetof(typeof(*buffer), member)); \
     } while (false)
 
-    gl_set_vertex_attribute(VERTEX_ATTR_POS, r->vertices, pos);
-    gl_set_vertex_attribute(VERTEX_ATTR_COLOR, r->vertices, color);
-    gl_set_vertex_attribute(VERTEX_ATTR_UV, r->vertices, uv);
+    gl_set_vertex_attribute(VERTEX_ATTR_POS, r->vertices.data, pos);
+    gl_set_vertex_attribute(VERTEX_ATTR_COLOR, r->vertices.data, color);
+    gl_set_vertex_attribute(VERTEX_ATTR_UV, r->vertices.data, uv);
 #undef gl_set_vertex_attribute
 }
 
 void renderer_vertex(renderer_t *r, v2f_t p, v4f_t c, v2f_t uv)
 {
-    if (r->vertex_count >= RENDERER_VERTICES_CAP) {
-        panic("Ran out of vertices");
-    }
-    vertex_t *v = r->vertices + r->vertex_count++;
-    v->pos = p;
-    v->color = c;
-    v->uv = uv;
+    vertex_t v = {
+        .uv = uv,
+        .pos = p,
+        .color = c,
+    };
+    da_push(&r->vertices, &v);
 }
 
 void renderer_triangle(
@@ -90,9 +92,11 @@ void renderer_image_rect(renderer_t *r, v2f_t p, v2f_t s, v2f_t uvp, v2f_t uvs,
 void renderer_draw(renderer_t *r)
 {
     glBindVertexArray(r->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
-    glBufferSubData(
-            GL_ARRAY_BUFFER, 0, r->vertex_count * sizeof *r->vertices, r->vertices);
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei) r->vertex_count);
-    r->vertex_count = 0;
+    for (size_t i = 0; i < r->vertices.length; i += RENDERER_CHUNK_VERTICES) {
+        size_t count = min(r->vertices.length - i, (size_t) RENDERER_CHUNK_VERTICES);
+        size_t offset = stream_push(
+                &r->stream, r->vertices.data + i, count * sizeof *r->vertices.data);
+        glDrawArrays(GL_TRIANGLES, offset / sizeof *r->vertices.data, (GLsizei) count);
+    }
+    r->vertices.length = 0;
 }
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+
+#include "save.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib.h"
+
+static double save_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Write every span with as few system calls as possible, resuming after short writes
+static bool save_write(int fd, buffer_snapshot_t const *snapshot)
+{
+    struct iovec iov[IOV_MAX];
+    size_t span = 0;
+    size_t offset = 0; // Into `span`, after a short write
+    while (span < snapshot->spans.length) {
+        int count = 0;
+        for (size_t i = span; i < snapshot->spans.length && count < IOV_MAX; i++) {
+            strview_t s = snapshot->spans.data[i];
+            size_t skip = i == span ? offset : 0;
+            iov[count++] = (struct iovec) {
+                .iov_base = (char *) s.data + skip,
+                .iov_len = s.length - skip,
+            };
+        }
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip whatever was written
+        size_t written = n;
+        while (span < snapshot->spans.length &&
+               written >= snapshot->spans.data[span].length - offset) {
+            written -= snapshot->spans.data[span].length - offset;
+            span++;
+            offset = 0;
+        }
+        offset += written;
+    }
+    return true;
+}
+
+// The rename itself is only durable once the directory is synced too
+static bool save_sync_dir(char const *path)
+{
+    char *copy = strdup(path);
+    int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    free(copy);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Create a temporary file next to `path`. New files get their mode from the umask like
+// any other file; existing ones keep theirs.
+static int save_create_tmp(char const *path, char *tmp_path, size_t tmp_size)
+{
+    struct stat filestat;
+    bool exists = stat(path, &filestat) == 0;
+    for (unsigned attempt = 0; attempt < 100; attempt++) {
+        snprintf(tmp_path, tmp_size, "%s.%d-%u.tmp", path, getpid(), attempt);
+        int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd < 0 && errno == EEXIST) {
+            continue;
+        }
+        if (fd >= 0 && exists && fchmod(fd, filestat.st_mode & 07777) != 0) {
+            close(fd);
+            unlink(tmp_path);
+            return -1;
+        }
+        return fd;
+    }
+    return -1;
+}
+
+// Write a temporary file and rename it over the target
+static void save_replace(save_t *s)
+{
+    size_t tmp_size = strlen(s->path) + 32;
+    char *tmp_path = malloc(tmp_size);
+    int fd = save_create_tmp(s->path, tmp_path, tmp_size);
+    if (fd < 0) {
+        s->failed = "create";
+        defer(s->error = errno);
+    }
+
+    bool renamed = false;
+    if (!save_write(fd, &s->snapshot)) {
+        s->failed = "write";
+    } else if (fsync(fd) != 0) {
+        s->failed = "fsync";
+    }
+    if (s->failed != NULL) {
+        s->error = errno;
+        close(fd);
+    } else if (close(fd) != 0) {
+        s->failed = "close";
+        s->error = errno;
+    } else if (rename(tmp_path, s->path) != 0) {
+        s->failed = "rename";
+        s->error = errno;
+    } else {
+        renamed = true;
+        if (!save_sync_dir(s->path)) {
+            s->failed = "sync directory";
+            s->error = errno;
+        }
+    }
+    if (!renamed) {
+        unlink(tmp_path);
+    }
+
+defer:
+    free(tmp_path);
+}
+
+static void save_in_place(save_t *s)
+{
+    int fd = open(s->path, O_WRONLY);
+    if (fd < 0) {
+        s->failed = "open";
+        s->error = errno;
+        return;
+    }
+    for (size_t i = 0; i < s->ranges.length && s->failed == NULL; i++) {
+        strview_t span = s->snapshot.spans.data[i];
+        off_t offset = s->ranges.data[i].start;
+        for (size_t written = 0; written < span.length;) {
+            ssize_t n = pwrite(
+                    fd, span.data + written, span.length - written, offset + written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                s->failed = "write";
+                break;
+            }
+            written += n;
+        }
+    }
+    if (s->failed == NULL && fsync(fd) != 0) {
+        s->failed = "fsync";
+    }
+    if (s->failed != NULL) {
+        s->error = errno;
+    }
+    close(fd);
+}
+
+static void *save_thread(void *arg)
+{
+    save_t *s = arg;
+    double start = save_now();
+    if (s->in_place) {
+        save_in_place(s);
+    } else {
+        save_replace(s);
+    }
+    if (s->failed == NULL && stat(s->path, &s->stat) != 0) {
+        s->failed = "stat";
+        s->error = errno;
+    }
+    s->seconds = save_now() - start;
+    atomic_store(&s->done, true);
+    return NULL;
+}
+
+static void save_join(save_t *s)
+{
+    pthread_join(s->thread, NULL);
+    s->running = false;
+    buffer_snapshot_free(&s->snapshot);
+    da_free(&s->ranges);
+}
+
+void save_free(save_t *s)
+{
+    if (s->running) {
+        save_join(s);
+    }
+    buffer_snapshot_free(&s->snapshot);
+    da_free(&s->ranges);
+    free(s->path);
+    *s = (save_t) { 0 };
+}
+
+static void save_launch(save_t *s, char const *path, buffer_snapshot_t *snapshot)
+{
+    s->path = strdup(path);
+    s->snapshot = *snapshot;
+    s->length = snapshot->length;
+    *snapshot = (buffer_snapshot_t) { 0 };
+    if (pthread_create(&s->thread, NULL, save_thread, s) != 0) {
+        panic("Could not start the save thread: %s", strerror(errno));
+    }
+    s->running = true;
+}
+
+void save_start(save_t *s, char const *path, buffer_snapshot_t *snapshot)
+{
+    save_free(s);
+    save_launch(s, path, snapshot);
+}
+
+void save_start_in_place(
+        save_t *s, char const *path, buffer_snapshot_t *snapshot,
+        buffer_ranges_t *ranges)
+{
+    assert(ranges->length == snapshot->spans.length && ranges->length > 0);
+    save_free(s);
+    s->ranges = *ranges;
+    s->in_place = true;
+    *ranges = (buffer_ranges_t) { 0 };
+    save_launch(s, path, snapshot);
+}
+
+bool save_poll(save_t *s)
+{
+    if (!s->running) {
+        return false;
+    }
+    if (!atomic_load(&s->done)) {
+        return true;
+    }
+    save_join(s);
+    return false;
+}
+
+void save_wait(save_t *s)
+{
+    if (s->running) {
+        save_join(s);
+    }
+}
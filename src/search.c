@@ -0,0 +1,295 @@
+#include "search.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib.h"
+
+// Text made of consecutive spans, starting at offset `base` of the buffer
+typedef struct {
+    strview_t const *spans;
+    size_t span_count;
+    size_t *ends; // Offset right after each span, relative to the text
+    size_t base;
+    size_t length;
+
+    char const *needle;
+    size_t needle_length;
+    size_t stop;               // Matches start before it
+    size_t max;                // Matches kept
+    atomic_bool const *cancel; // NULL when the batch runs to the end
+    search_matches_t *tasks;   // Matches starting in each task
+} search_batch_t;
+
+// Index of the span holding `index`
+static size_t search_span_at(search_batch_t const *batch, size_t index)
+{
+    size_t lo = 0, hi = batch->span_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (batch->ends[mid] <= index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Whether the needle occurs at `index`, which is in span `span` and may continue in the
+// spans after it
+static bool search_match_at(search_batch_t const *batch, size_t span, size_t index)
+{
+    size_t n = batch->needle_length;
+    if (index + n > batch->length) {
+        return false;
+    }
+    size_t offset = index - (batch->ends[span] - batch->spans[span].length);
+    for (size_t matched = 0; matched < n; span++, offset = 0) {
+        char const *data = batch->spans[span].data + offset;
+        size_t length = min(batch->spans[span].length - offset, n - matched);
+        if (memcmp(data, batch->needle + matched, length) != 0) {
+            return false;
+        }
+        matched += length;
+    }
+    return true;
+}
+
+static void search_task(void *ctx, size_t worker, size_t index)
+{
+    (void) worker;
+    search_batch_t *batch = ctx;
+    if (batch->cancel != NULL && atomic_load(batch->cancel)) {
+        return;
+    }
+    char const *needle = batch->needle;
+    size_t n = batch->needle_length;
+    search_matches_t *matches = &batch->tasks[index];
+
+    size_t at = index * SEARCH_SPAN;
+    size_t end = min(at + SEARCH_SPAN, batch->stop);
+    size_t limit = min(end + n - 1, batch->length); // Matches starting before `end`
+    for (size_t i = search_span_at(batch, at);
+         at < end && matches->length < batch->max; at = batch->ends[i++]) {
+        strview_t span = batch->spans[i];
+        size_t span_start = batch->ends[i] - span.length;
+
+        // Matches within the span are found without going through the spans
+        strview_t rest = {
+            .data = span.data + (at - span_start),
+            .length = min(batch->ends[i], limit) - at,
+        };
+        size_t found;
+        while (matches->length < batch->max &&
+               (found = sv_find(rest, needle, n)) < rest.length) {
+            size_t match = batch->base + span_start + (rest.data - span.data) + found;
+            da_push(matches, &match);
+            rest.data += found + 1;
+            rest.length -= found + 1;
+        }
+        // Those that continue in the next spans start in the last `n - 1` bytes
+        size_t from = max(at, batch->ends[i] - min(batch->ends[i], n - 1));
+        for (size_t p = from; p < min(batch->ends[i], end); p++) {
+            if (matches->length < batch->max && search_match_at(batch, i, p)) {
+                size_t match = batch->base + p;
+                da_push(matches, &match);
+            }
+        }
+    }
+}
+
+// Find the matches of the needle in the spans of `batch` and store them in `out`
+static void search_batch(pool_t *pool, search_batch_t *batch, search_matches_t *out)
+{
+    out->length = 0;
+    if (batch->needle_length == 0 || batch->span_count == 0) {
+        return;
+    }
+    batch->ends = malloc(batch->span_count * sizeof *batch->ends);
+    batch->length = 0;
+    for (size_t i = 0; i < batch->span_count; i++) {
+        batch->length += batch->spans[i].length;
+        batch->ends[i] = batch->length;
+    }
+    batch->stop = min(batch->stop, batch->length);
+    size_t count = (batch->stop + SEARCH_SPAN - 1) / SEARCH_SPAN;
+    batch->tasks = calloc(count, sizeof *batch->tasks);
+    pool_t none = { 0 };
+    pool_run(pool != NULL ? pool : &none, count, search_task, batch);
+
+    // Tasks are in text order, so concatenating them keeps the matches sorted
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += batch->tasks[i].length;
+    }
+    da_grow_n(out, min(total, batch->max));
+    for (size_t i = 0; i < count; i++) {
+        size_t n = min(batch->tasks[i].length, batch->max - out->length);
+        if (n > 0) {
+            memcpy(out->data + out->length, batch->tasks[i].data, n * sizeof *out->data);
+            out->length += n;
+        }
+        da_free(&batch->tasks[i]);
+    }
+    free(batch->tasks);
+    free(batch->ends);
+}
+
+// Chunks of `b` that hold [start, end)
+static void
+search_chunks(buffer_t const *b, size_t start, size_t end, search_spans_t *out)
+{
+    while (start < end) {
+        strview_t chunk = buffer_chunk(b, start);
+        chunk.length = min(chunk.length, end - start);
+        da_push(out, &chunk);
+        start += chunk.length;
+    }
+}
+
+void search_all(
+        pool_t *pool, buffer_t const *b, char const *needle, size_t needle_length,
+        search_matches_t *out)
+{
+    search_spans_t spans = { 0 };
+    search_chunks(b, 0, buffer_length(b), &spans);
+    search_batch_t batch = {
+        .spans = spans.data,
+        .span_count = spans.length,
+        .needle = needle,
+        .needle_length = needle_length,
+        .stop = SIZE_MAX,
+        .max = SIZE_MAX,
+    };
+    search_batch(pool, &batch, out);
+    da_free(&spans);
+}
+
+void search_range(
+        pool_t *pool, buffer_t const *b, char const *needle, size_t needle_length,
+        size_t start, size_t end, search_matches_t *out)
+{
+    out->length = 0;
+    end = min(end, buffer_length(b));
+    if (start >= end) {
+        return;
+    }
+    search_spans_t spans = { 0 };
+    search_chunks(b, start, min(end + needle_length - 1, buffer_length(b)), &spans);
+    search_batch_t batch = {
+        .spans = spans.data,
+        .span_count = spans.length,
+        .base = start,
+        .needle = needle,
+        .needle_length = needle_length,
+        .stop = end - start,
+        .max = SEARCH_MATCHES_MAX,
+    };
+    search_batch(pool, &batch, out);
+    da_free(&spans);
+}
+
+size_t search_lower_bound(search_matches_t const *matches, size_t index)
+{
+    size_t lo = 0, hi = matches->length;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (matches->data[mid] < index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Background search
+
+static void *search_thread(void *arg)
+{
+    search_t *s = arg;
+    search_batch_t batch = {
+        .spans = s->spans.data,
+        .span_count = s->spans.length,
+        .needle = s->needle.data,
+        .needle_length = s->needle.length,
+        .stop = SIZE_MAX,
+        .max = SIZE_MAX,
+        .cancel = &s->cancel,
+    };
+    search_batch(s->pool, &batch, &s->matches);
+    atomic_store(&s->done, true);
+    return NULL;
+}
+
+static void search_join(search_t *s)
+{
+    pthread_join(s->thread, NULL);
+    s->running = false;
+    s->complete = !atomic_load(&s->cancel);
+}
+
+void search_free(search_t *s)
+{
+    if (s->running) {
+        atomic_store(&s->cancel, true);
+        search_join(s);
+    }
+    da_free(&s->spans);
+    str_free(&s->needle);
+    da_free(&s->matches);
+    *s = (search_t) { 0 };
+}
+
+void search_start(
+        search_t *s, pool_t *pool, buffer_t const *b, char const *needle,
+        size_t needle_length)
+{
+    if (s->running) {
+        atomic_store(&s->cancel, true);
+        search_join(s);
+    }
+    s->pool = pool;
+    s->spans.length = 0;
+    search_chunks(b, 0, buffer_length(b), &s->spans);
+    s->version = b->version;
+    s->needle.length = 0;
+    str_push(&s->needle, needle, needle_length);
+    s->complete = false;
+    s->matches.length = 0;
+    atomic_store(&s->done, false);
+    atomic_store(&s->cancel, false);
+    if (pthread_create(&s->thread, NULL, search_thread, s) != 0) {
+        panic("Could not start the search thread: %s", strerror(errno));
+    }
+    s->running = true;
+}
+
+bool search_poll(search_t *s)
+{
+    if (!s->running) {
+        return false;
+    }
+    if (!atomic_load(&s->done)) {
+        return true;
+    }
+    search_join(s);
+    return false;
+}
+
+void search_wait(search_t *s)
+{
+    if (s->running) {
+        search_join(s);
+    }
+}
+
+bool search_started(
+        search_t const *s, size_t version, char const *needle, size_t needle_length)
+{
+    return s->version == version && s->needle.length == needle_length &&
+           (needle_length == 0 || memcmp(s->needle.data, needle, needle_length) == 0);
+}
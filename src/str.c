@@ -1,7 +1,10 @@
+#define _GNU_SOURCE
+
 #include "str.h"
 
 #include <assert.h>
 #include <dirent.h>
+#include <stdatomic.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,45 +44,34 @@ void str_remove(str_t *s, size_t length, size_t index)
     s->data[s->length] = '\0';
 }
 
+// memchr and memrchr are already vectorized by the C library
+
 size_t str_find_char(str_t const *s, char c, size_t index)
 {
-    while (index < s->length && s->data[index] != c) {
-        index++;
+    if (index >= s->length) {
+        return index;
     }
-    return index;
+    char const *p = memchr(s->data + index, c, s->length - index);
+    return p != NULL ? (size_t) (p - s->data) : s->length;
 }
 
 size_t str_find_char_rev(str_t const *s, char c, size_t index)
 {
     assert(index <= s->length);
-    while (index > 0 && s->data[--index] != c) {
-        continue;
-    }
-    return index;
+    char const *p = memrchr(s->data, c, index);
+    return p != NULL ? (size_t) (p - s->data) : 0;
 }
 
 size_t str_count(str_t const *s, char c, size_t index)
 {
     assert(index <= s->length);
-    size_t count = 0;
-    while (index < s->length) {
-        if (s->data[index++] == c) {
-            count++;
-        }
-    }
-    return count;
+    return sv_count_char((strview_t) { s->data + index, s->length - index }, c);
 }
 
 size_t str_count_rev(str_t const *s, char c, size_t index)
 {
     assert(index <= s->length);
-    size_t count = 0;
-    while (index > 0) {
-        if (s->data[--index] == c) {
-            count++;
-        }
-    }
-    return count;
+    return sv_count_char((strview_t) { s->data, index }, c);
 }
 
 void str_load_file(str_t *s, FILE *fp)
@@ -144,6 +136,176 @@ static void str_grow(str_t *s, size_t size)
 
 // String View
 
+static _Atomic enum simd simd_max = SIMD_AVX2;
+
+// The CPU is checked on the first call; racing threads detect the same
+enum simd sv_simd_level(void)
+{
+    static _Atomic enum simd level = SIMD_UNKNOWN;
+    enum simd l = atomic_load_explicit(&level, memory_order_relaxed);
+    if (l == SIMD_UNKNOWN) {
+        l = SIMD_NONE;
+#ifdef __x86_64__
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            l = SIMD_AVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            l = SIMD_SSE2;
+        }
+#endif
+        atomic_store_explicit(&level, l, memory_order_relaxed);
+    }
+    enum simd limit = atomic_load_explicit(&simd_max, memory_order_relaxed);
+    return min(l, limit);
+}
+
+void sv_simd_limit(enum simd level)
+{
+    atomic_store_explicit(&simd_max, level, memory_order_relaxed);
+}
+
+static size_t count_char_scalar(char const *data, size_t length, char c)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        count += data[i] == c;
+    }
+    return count;
+}
+
+static size_t find_scalar(char const *data, size_t length, char const *needle, size_t n)
+{
+    char const *p = memmem(data, length, needle, n);
+    return p != NULL ? (size_t) (p - data) : length;
+}
+
+#ifdef __x86_64__
+    #include <immintrin.h>
+
+    #define LANE_MAX 255 // Blocks counted per byte lane before the lanes are summed up
+
+// Matches are counted per byte lane, by subtracting the all-ones comparison results
+__attribute__((target("sse2"))) static size_t
+count_char_sse2(char const *data, size_t length, char c)
+{
+    __m128i const needle = _mm_set1_epi8(c);
+    __m128i const zero = _mm_setzero_si128();
+    size_t count = 0;
+    size_t i = 0;
+    while (length - i >= 16) {
+        size_t blocks = min((length - i) / 16, (size_t) LANE_MAX);
+        __m128i lanes = zero;
+        for (size_t b = 0; b < blocks; b++, i += 16) {
+            __m128i bytes = _mm_loadu_si128((__m128i const *) (data + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(bytes, needle));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += _mm_cvtsi128_si64(sums) + _mm_extract_epi16(sums, 4);
+    }
+    return count + count_char_scalar(data + i, length - i, c);
+}
+
+__attribute__((target("avx2"))) static size_t
+count_char_avx2(char const *data, size_t length, char c)
+{
+    __m256i const needle = _mm256_set1_epi8(c);
+    __m256i const zero = _mm256_setzero_si256();
+    size_t count = 0;
+    size_t i = 0;
+    while (length - i >= 32) {
+        size_t blocks = min((length - i) / 32, (size_t) LANE_MAX);
+        __m256i lanes = zero;
+        for (size_t b = 0; b < blocks; b++, i += 32) {
+            __m256i bytes = _mm256_loadu_si256((__m256i const *) (data + i));
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(bytes, needle));
+        }
+        __m256i sums = _mm256_sad_epu8(lanes, zero);
+        count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                 _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+    return count + count_char_scalar(data + i, length - i, c);
+}
+
+// Candidates are positions where both the first and the last byte of the needle match,
+// which rules out almost every position of ordinary text at once
+__attribute__((target("sse2"))) static size_t
+find_sse2(char const *data, size_t length, char const *needle, size_t n)
+{
+    __m128i const first = _mm_set1_epi8(needle[0]);
+    __m128i const last = _mm_set1_epi8(needle[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((__m128i const *) (data + i));
+        __m128i b = _mm_loadu_si128((__m128i const *) (data + i + n - 1));
+        unsigned mask = _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (n <= 2 || memcmp(data + at + 1, needle + 1, n - 2) == 0) {
+                return at;
+            }
+        }
+    }
+    return i + find_scalar(data + i, length - i, needle, n);
+}
+
+__attribute__((target("avx2"))) static size_t
+find_avx2(char const *data, size_t length, char const *needle, size_t n)
+{
+    __m256i const first = _mm256_set1_epi8(needle[0]);
+    __m256i const last = _mm256_set1_epi8(needle[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256((__m256i const *) (data + i));
+        __m256i b = _mm256_loadu_si256((__m256i const *) (data + i + n - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (n <= 2 || memcmp(data + at + 1, needle + 1, n - 2) == 0) {
+                return at;
+            }
+        }
+    }
+    return i + find_scalar(data + i, length - i, needle, n);
+}
+#endif // __x86_64__
+
+size_t sv_count_char(strview_t sv, char c)
+{
+    switch (sv_simd_level()) {
+#ifdef __x86_64__
+        case SIMD_AVX2:
+            return count_char_avx2(sv.data, sv.length, c);
+        case SIMD_SSE2:
+            return count_char_sse2(sv.data, sv.length, c);
+#endif
+        default:
+            return count_char_scalar(sv.data, sv.length, c);
+    }
+}
+
+size_t sv_find(strview_t sv, char const *needle, size_t needle_length)
+{
+    if (needle_length == 0) {
+        return 0;
+    }
+    if (needle_length == 1) {
+        char const *p = memchr(sv.data, needle[0], sv.length);
+        return p != NULL ? (size_t) (p - sv.data) : sv.length;
+    }
+    switch (sv_simd_level()) {
+#ifdef __x86_64__
+        case SIMD_AVX2:
+            return find_avx2(sv.data, sv.length, needle, needle_length);
+        case SIMD_SSE2:
+            return find_sse2(sv.data, sv.length, needle, needle_length);
+#endif
+        default:
+            return find_scalar(sv.data, sv.length, needle, needle_length);
+    }
+}
+
 strview_t sv_from_str(str_t const *str)
 {
     return (strview_t) {
@@ -0,0 +1,109 @@
+#include "stream.h"
+
+#include <string.h>
+
+#include "lib.h"
+
+#define STREAM_ALIGNMENT 64
+
+enum stream_mode stream_mode = STREAM_RING;
+
+static void stream_resize(stream_t *s, size_t region_size);
+static void stream_next_region(stream_t *s);
+
+void stream_free(stream_t *s)
+{
+    for (size_t i = 0; i < STREAM_REGIONS; i++) {
+        if (s->fences[i] != NULL) {
+            glDeleteSync(s->fences[i]);
+        }
+    }
+    glDeleteBuffers(1, &s->vbo);
+    *s = (stream_t) { 0 };
+}
+
+void stream_init(stream_t *s, size_t region_size)
+{
+    *s = (stream_t) { 0 };
+    glGenBuffers(1, &s->vbo);
+    stream_resize(s, region_size);
+}
+
+size_t stream_push(stream_t *s, void const *data, size_t size)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+    if (size > s->region_size) {
+        size_t region_size = s->region_size;
+        while (region_size < size) {
+            region_size *= 2;
+        }
+        stream_resize(s, region_size);
+    }
+
+    switch (stream_mode) {
+        case STREAM_RING:
+            break;
+        case STREAM_ORPHAN:
+            glBufferData(
+                    GL_ARRAY_BUFFER, STREAM_REGIONS * s->region_size, NULL,
+                    GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+            return 0;
+        case STREAM_SUBDATA:
+            glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+            return 0;
+        default:
+            panic("Unreachable");
+    }
+
+    if (s->offset + size > s->region_size) {
+        stream_next_region(s);
+    }
+    size_t offset = s->region * s->region_size + s->offset;
+    void *p = glMapBufferRange(
+            GL_ARRAY_BUFFER, offset, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (p == NULL) {
+        panic("Could not map stream buffer");
+    }
+    memcpy(p, data, size);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    s->offset += (size + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+    return offset;
+}
+
+// Reallocating the storage orphans the old one, so pending fences no longer matter
+static void stream_resize(stream_t *s, size_t region_size)
+{
+    region_size =
+            (region_size + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+    for (size_t i = 0; i < STREAM_REGIONS; i++) {
+        if (s->fences[i] != NULL) {
+            glDeleteSync(s->fences[i]);
+            s->fences[i] = NULL;
+        }
+    }
+    s->region_size = region_size;
+    s->region = 0;
+    s->offset = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+    glBufferData(GL_ARRAY_BUFFER, STREAM_REGIONS * region_size, NULL, GL_STREAM_DRAW);
+}
+
+static void stream_next_region(stream_t *s)
+{
+    s->fences[s->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s->region = (s->region + 1) % STREAM_REGIONS;
+    s->offset = 0;
+
+    GLsync fence = s->fences[s->region];
+    if (fence != NULL) {
+        GLenum status;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        s->fences[s->region] = NULL;
+    }
+}
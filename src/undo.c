@@ -0,0 +1,320 @@
+#include "undo.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib.h"
+
+static undo_mark_t undo_mark(undo_t const *u);
+static void undo_release(undo_t *u, undo_mark_t mark);
+static char *undo_alloc(undo_t *u, size_t length);
+static void undo_capture(
+        undo_t *u, buffer_t const *b, size_t index, size_t length, size_t first,
+        size_t at);
+static void undo_truncate(undo_t *u);
+static void undo_trim(undo_t *u);
+
+void undo_free(undo_t *u)
+{
+    for (size_t i = 0; i < u->blocks.length; i++) {
+        free(u->blocks.data[i].data);
+    }
+    da_free(&u->blocks);
+    da_free(&u->records);
+    da_free(&u->spans);
+    *u = (undo_t) { 0 };
+}
+
+void undo_init(undo_t *u, size_t budget)
+{
+    *u = (undo_t) { .budget = budget };
+}
+
+void undo_clear(undo_t *u)
+{
+    size_t budget = u->budget;
+    undo_free(u);
+    undo_init(u, budget);
+}
+
+void undo_boundary(undo_t *u)
+{
+    u->open = false;
+}
+
+// Text removed right before the previous removal was deleted backward, right at it
+// forward. Nothing extends a record across a boundary.
+static bool
+undo_extends(undo_t const *u, enum undo_kind kind, size_t index, size_t length)
+{
+    if (!u->open || u->records.length == 0) {
+        return false;
+    }
+    undo_record_t const *r = &da_last(&u->records);
+    if (!r->coalesce || r->kind != kind || r->edits >= UNDO_COALESCE_MAX) {
+        return false;
+    }
+    if (kind == UNDO_INSERT) {
+        return index == r->index + r->length;
+    }
+    return index == r->index || index + length == r->index;
+}
+
+void undo_record(
+        undo_t *u, buffer_t const *b, enum undo_kind kind, size_t index, size_t length,
+        bool coalesce)
+{
+    if (length == 0) {
+        return;
+    }
+    undo_truncate(u);
+
+    if (coalesce && undo_extends(u, kind, index, length)) {
+        undo_record_t *last = &da_last(&u->records);
+        bool before = kind == UNDO_REMOVE && index < last->index;
+        size_t at = before ? last->span : u->spans.length;
+        undo_capture(u, b, index, length, last->span, at);
+        last = &da_last(&u->records);
+        last->span_count = u->spans.length - last->span;
+        last->index = min(last->index, index);
+        last->length += length;
+        last->edits++;
+        undo_trim(u);
+        return;
+    }
+
+    // Copying text that can never fit would only drop it right away
+    if (!buffer_stable(b) && length > u->budget) {
+        undo_clear(u);
+        return;
+    }
+    // A self-insert or deletion that doesn't extend the last record is a command of its
+    // own, other edits join the group of the command that made them
+    if (!u->open || coalesce) {
+        u->group++;
+        u->open = true;
+    }
+    undo_record_t record = {
+        .kind = kind,
+        .index = index,
+        .length = length,
+        .span = u->spans.length,
+        .group = u->group,
+        .edits = 1,
+        .coalesce = coalesce,
+        .mark = undo_mark(u),
+    };
+    undo_capture(u, b, index, length, record.span, record.span);
+    record.span_count = u->spans.length - record.span;
+    da_push(&u->records, &record);
+    u->current = u->records.length;
+    undo_trim(u);
+}
+
+static void undo_apply(
+        undo_record_t const *r, strview_t const *spans, buffer_t *b, bool insert,
+        size_t *cursor)
+{
+    if (insert) {
+        buffer_insert_spans(b, spans + r->span, r->span_count, r->index);
+        *cursor = r->index + r->length;
+    } else {
+        buffer_remove(b, r->length, r->index);
+        *cursor = r->index;
+    }
+}
+
+bool undo_undo(undo_t *u, buffer_t *b, size_t *cursor)
+{
+    if (u->current == 0) {
+        return false;
+    }
+    size_t group = u->records.data[u->current - 1].group;
+    while (u->current > 0 && u->records.data[u->current - 1].group == group) {
+        undo_record_t const *r = &u->records.data[--u->current];
+        undo_apply(r, u->spans.data, b, r->kind == UNDO_REMOVE, cursor);
+    }
+    // Edits after an undo start over instead of extending the record before it
+    if (u->current > 0) {
+        u->records.data[u->current - 1].coalesce = false;
+    }
+    u->open = false;
+    return true;
+}
+
+bool undo_redo(undo_t *u, buffer_t *b, size_t *cursor)
+{
+    if (u->current == u->records.length) {
+        return false;
+    }
+    size_t group = u->records.data[u->current].group;
+    while (u->current < u->records.length &&
+           u->records.data[u->current].group == group) {
+        undo_record_t *r = &u->records.data[u->current++];
+        undo_apply(r, u->spans.data, b, r->kind == UNDO_INSERT, cursor);
+        r->coalesce = false;
+    }
+    u->open = false;
+    return true;
+}
+
+void undo_detach(undo_t *u, char const *data, size_t length)
+{
+    for (size_t i = 0; i < u->spans.length; i++) {
+        strview_t *span = &u->spans.data[i];
+        if (span->data < data + length && data < span->data + span->length) {
+            char *copy = undo_alloc(u, span->length);
+            memcpy(copy, span->data, span->length);
+            span->data = copy;
+        }
+    }
+    u->pinned = undo_mark(u);
+}
+
+size_t undo_used(undo_t const *u)
+{
+    return u->arena + u->records.length * sizeof *u->records.data +
+           u->spans.length * sizeof *u->spans.data;
+}
+
+static undo_mark_t undo_mark(undo_t const *u)
+{
+    if (u->blocks.length == 0) {
+        return (undo_mark_t) { 0 };
+    }
+    return (undo_mark_t) { u->blocks.length - 1, da_last(&u->blocks).used };
+}
+
+// Free everything allocated after `mark`
+static void undo_release(undo_t *u, undo_mark_t mark)
+{
+    while (u->blocks.length > mark.block + 1) {
+        undo_block_t block = u->blocks.data[--u->blocks.length];
+        u->arena -= block.capacity;
+        free(block.data);
+    }
+    if (u->blocks.length > 0) {
+        da_last(&u->blocks).used = mark.used;
+    }
+}
+
+static char *undo_alloc(undo_t *u, size_t length)
+{
+    undo_block_t *last = u->blocks.length > 0 ? &da_last(&u->blocks) : NULL;
+    if (last == NULL || last->used + length > last->capacity) {
+        // Small budgets must not be used up by a single block
+        size_t size = min((size_t) UNDO_BLOCK_SIZE, u->budget / 8);
+        undo_block_t block = { .capacity = max(length, size) };
+        block.data = malloc(block.capacity);
+        da_push(&u->blocks, &block);
+        u->arena += block.capacity;
+    }
+    undo_block_t *block = &da_last(&u->blocks);
+    char *p = block->data + block->used;
+    block->used += length;
+    return p;
+}
+
+// Insert spans holding [index, index + length) of `b` at `at`, for the record whose
+// spans start at `first`. Text that follows its last span in memory extends it instead.
+static void undo_capture(
+        undo_t *u, buffer_t const *b, size_t index, size_t length, size_t first,
+        size_t at)
+{
+    bool stable = buffer_stable(b);
+    char *copy = stable ? NULL : undo_alloc(u, length);
+    for (size_t end = index + length; index < end;) {
+        strview_t chunk = buffer_chunk(b, index);
+        chunk.length = min(chunk.length, end - index);
+        index += chunk.length;
+        if (copy != NULL) {
+            memcpy(copy, chunk.data, chunk.length);
+            chunk.data = copy;
+            copy += chunk.length;
+        }
+        strview_t *prev = at > first ? &u->spans.data[at - 1] : NULL;
+        if (prev != NULL && at == u->spans.length &&
+            prev->data + prev->length == chunk.data) {
+            prev->length += chunk.length;
+        } else {
+            da_insert_n(&u->spans, &chunk, 1, at);
+            at++;
+        }
+    }
+}
+
+// A new edit makes the undone records unreachable
+static void undo_truncate(undo_t *u)
+{
+    if (u->current == u->records.length) {
+        return;
+    }
+    undo_record_t const *first = &u->records.data[u->current];
+    undo_mark_t mark = first->mark;
+    if (u->pinned.block > mark.block ||
+        (u->pinned.block == mark.block && u->pinned.used > mark.used)) {
+        mark = u->pinned;
+    }
+    u->spans.length = first->span;
+    u->records.length = u->current;
+    undo_release(u, mark);
+    if (u->current > 0) {
+        da_last(&u->records).coalesce = false;
+    }
+    u->open = false;
+}
+
+// Drop the oldest groups until the journal is well below the budget, so that this
+// doesn't happen again on the next edit
+static void undo_trim(undo_t *u)
+{
+    if (undo_used(u) <= u->budget) {
+        return;
+    }
+    size_t target = u->budget / 4 * 3;
+    size_t last_group = da_last(&u->records).group;
+    size_t k = 0;      // Records dropped
+    size_t blocks = 0; // Arena blocks dropped
+    size_t freed = 0;
+    size_t freed_blocks = 0;
+    while (u->records.data[k].group != last_group && undo_used(u) - freed > target) {
+        size_t group = u->records.data[k].group;
+        while (u->records.data[k].group == group) {
+            k++;
+        }
+        // Text copied for the remaining records is allocated after their mark
+        for (; blocks < u->records.data[k].mark.block; blocks++) {
+            freed_blocks += u->blocks.data[blocks].capacity;
+        }
+        freed = freed_blocks + k * sizeof *u->records.data +
+                u->records.data[k].span * sizeof *u->spans.data;
+    }
+    if (undo_used(u) - freed > u->budget) {
+        undo_clear(u);
+        return;
+    }
+
+    size_t spans = u->records.data[k].span;
+    if (blocks > 0) {
+        for (size_t i = 0; i < blocks; i++) {
+            free(u->blocks.data[i].data);
+            u->arena -= u->blocks.data[i].capacity;
+        }
+        da_remove_n(&u->blocks, blocks, 0);
+    }
+    if (spans > 0) {
+        da_remove_n(&u->spans, spans, 0);
+    }
+    da_remove_n(&u->records, k, 0);
+    for (size_t i = 0; i < u->records.length; i++) {
+        u->records.data[i].span -= spans;
+        u->records.data[i].mark.block -= blocks;
+    }
+    u->current -= k;
+    if (u->pinned.block >= blocks) {
+        u->pinned.block -= blocks;
+    } else {
+        u->pinned = (undo_mark_t) { 0 };
+    }
+}
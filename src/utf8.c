@@ -0,0 +1,90 @@
+#include "utf8.h"
+
+size_t utf8_sequence_length(char lead)
+{
+    unsigned char c = lead;
+    if (c < 0xc2) {
+        return 1;
+    } else if (c < 0xe0) {
+        return 2;
+    } else if (c < 0xf0) {
+        return 3;
+    } else if (c < 0xf5) {
+        return 4;
+    }
+    return 1;
+}
+
+size_t utf8_decode(char const *text, size_t text_size, uint32_t *codepoint)
+{
+    unsigned char const *s = (unsigned char const *) text;
+    if (s[0] < 0x80) {
+        *codepoint = s[0];
+        return 1;
+    }
+
+    size_t length = utf8_sequence_length(text[0]);
+    if (length == 1 || length > text_size) {
+        *codepoint = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    uint32_t cp = s[0] & (0x7f >> length);
+    for (size_t i = 1; i < length; i++) {
+        if (!utf8_is_continuation(text[i])) {
+            *codepoint = UTF8_REPLACEMENT;
+            return 1;
+        }
+        cp = (cp << 6) | (s[i] & 0x3f);
+    }
+
+    // Overlong encodings, surrogates and values past the last plane
+    static uint32_t const min_codepoint[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (cp < min_codepoint[length] || (0xd800 <= cp && cp < 0xe000) || cp > 0x10ffff) {
+        *codepoint = UTF8_REPLACEMENT;
+        return 1;
+    }
+    *codepoint = cp;
+    return length;
+}
+
+size_t utf8_encode(uint32_t codepoint, char out[UTF8_MAX_LENGTH])
+{
+    if (codepoint < 0x80) {
+        out[0] = codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = 0xc0 | (codepoint >> 6);
+        out[1] = 0x80 | (codepoint & 0x3f);
+        return 2;
+    } else if (codepoint < 0x10000) {
+        if (0xd800 <= codepoint && codepoint < 0xe000) {
+            return 0;
+        }
+        out[0] = 0xe0 | (codepoint >> 12);
+        out[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+        out[2] = 0x80 | (codepoint & 0x3f);
+        return 3;
+    } else if (codepoint <= 0x10ffff) {
+        out[0] = 0xf0 | (codepoint >> 18);
+        out[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+        out[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+        out[3] = 0x80 | (codepoint & 0x3f);
+        return 4;
+    }
+    return 0;
+}
+
+size_t utf8_incomplete_tail(char const *text, size_t text_size)
+{
+    // Walk back over at most UTF8_MAX_LENGTH - 1 continuation bytes to the lead byte
+    size_t tail = 0;
+    while (tail < text_size && tail < UTF8_MAX_LENGTH) {
+        char c = text[text_size - 1 - tail];
+        tail++;
+        if (!utf8_is_continuation(c)) {
+            return utf8_sequence_length(c) > tail ? tail : 0;
+        }
+    }
+    return 0;
+}